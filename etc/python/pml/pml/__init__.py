@@ -1 +1,7 @@
 from .pml import saveTxt, loadTxt
+try:
+    from ._pml import (Vector, Matrix, dot, logSumExp,
+                       fitGaussian, fitGamma, fitDirichlet)
+except ImportError:
+    # The compiled module is not built, only the text file functions work.
+    pass
@@ -0,0 +1,676 @@
+// Python bindings for pml Vector and Matrix.
+//
+// Vector and Matrix objects export their storage through the buffer
+// protocol (Matrix in Fortran order), so np.asarray(x) shares memory with
+// the C++ object instead of copying it. Functions accept these objects or
+// any buffer of doubles, e.g. numpy arrays; wrapped objects are used in
+// place, other buffers are copied once since pml containers own their
+// storage. The GIL is released while the C++ code runs.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cerrno>
+#include <fstream>
+#include <new>
+
+#include "pml.hpp"
+
+namespace {
+
+  // ------- Object layouts -------
+
+  // 'exports' counts the buffers handed out. The storage is never resized
+  // or reassigned after construction; a method that does must raise
+  // BufferError while exports > 0.
+  struct VectorObject {
+    PyObject_HEAD
+    pml::Vector *vector;
+    Py_ssize_t shape[1];
+    Py_ssize_t strides[1];
+    Py_ssize_t exports;
+  };
+
+  struct MatrixObject {
+    PyObject_HEAD
+    pml::Matrix *matrix;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+    Py_ssize_t exports;
+  };
+
+  PyTypeObject VectorType = {PyVarObject_HEAD_INIT(NULL, 0)};
+  PyTypeObject MatrixType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+  // Buffers must not be NULL, even when empty.
+  double empty_buffer[1];
+
+  PyObject *wrap(pml::Vector &&v) {
+    VectorObject *self = PyObject_New(VectorObject, &VectorType);
+    if (self) {
+      self->vector = new pml::Vector(std::move(v));
+      self->exports = 0;
+    }
+    return reinterpret_cast<PyObject*>(self);
+  }
+
+  PyObject *wrap(pml::Matrix &&m) {
+    MatrixObject *self = PyObject_New(MatrixObject, &MatrixType);
+    if (self) {
+      self->matrix = new pml::Matrix(std::move(m));
+      self->exports = 0;
+    }
+    return reinterpret_cast<PyObject*>(self);
+  }
+
+  // ------- Files -------
+
+  // The C++ loaders exit on malformed files, so files are checked and read
+  // here. Reads the ndim-D array saved with save() into the storage that
+  // allocate(dims) returns. Returns NULL on success or the reason the file
+  // was rejected. Runs without the GIL.
+  template <typename Allocate>
+  const char *load_array(const std::string &name, size_t ndim,
+                         Allocate allocate) {
+    pml::PmlzReader reader(name);
+    if (reader.is_open()) {
+      if (reader.dims().size() != ndim)
+        return "dimension mismatch";
+      double *data = allocate(reader.dims());
+      if (!reader.read(0, reader.size(), data))
+        return "corrupted file";
+      return NULL;
+    }
+    std::ifstream ifs(name, std::ios::binary | std::ios::in);
+    std::vector<double> header(ndim + 1);
+    if (!ifs.read(reinterpret_cast<char*>(header.data()),
+                  sizeof(double) * header.size()))
+      return "not a pml file";
+    if (header[0] != ndim)
+      return "dimension mismatch";
+    ifs.seekg(0, std::ios::end);
+    double available = (double(ifs.tellg()) - sizeof(double) * header.size())
+                       / sizeof(double);
+    std::vector<size_t> dims;
+    double length = 1;
+    for (size_t k = 1; k <= ndim; ++k) {
+      if (!(header[k] >= 0 && header[k] == std::floor(header[k])))
+        return "not a pml file";
+      dims.push_back(header[k]);
+      length *= header[k];
+    }
+    if (length != available)
+      return "file size does not match the shape";
+    double *data = allocate(dims);
+    ifs.seekg(sizeof(double) * header.size());
+    if (!ifs.read(reinterpret_cast<char*>(data), sizeof(double) * length))
+      return "corrupted file";
+    return NULL;
+  }
+
+  // Raises OSError for a failed save().
+  PyObject *save_error(const char *filename, int error) {
+    if (error) {
+      errno = error;
+      return PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    }
+    return PyErr_Format(PyExc_OSError, "cannot write '%s'", filename);
+  }
+
+  // ------- Arguments -------
+
+  // A function argument as a Vector (ndim = 1) or a Matrix (ndim = 2).
+  // Wrapped objects are used in place, other buffers are copied.
+  struct Array {
+    int ndim = 0;
+    const pml::Vector *vector = nullptr;
+    const pml::Matrix *matrix = nullptr;
+    pml::Vector vector_copy;
+    pml::Matrix matrix_copy;
+  };
+
+  bool is_double_format(const char *format) {
+    if (format == NULL)
+      return false;
+    if (*format == '@' || *format == '=' ||
+        (*format == '<' && PY_LITTLE_ENDIAN) ||
+        (*format == '>' && !PY_LITTLE_ENDIAN))
+      ++format;
+    return format[0] == 'd' && format[1] == 0;
+  }
+
+  bool to_array(PyObject *obj, Array &a) {
+    if (PyObject_TypeCheck(obj, &VectorType)) {
+      a.ndim = 1;
+      a.vector = reinterpret_cast<VectorObject*>(obj)->vector;
+      return true;
+    }
+    if (PyObject_TypeCheck(obj, &MatrixType)) {
+      a.ndim = 2;
+      a.matrix = reinterpret_cast<MatrixObject*>(obj)->matrix;
+      return true;
+    }
+    Py_buffer view;
+    if (PyObject_GetBuffer(obj, &view, PyBUF_RECORDS_RO) != 0)
+      return false;
+    bool ok = false;
+    if (!is_double_format(view.format)) {
+      PyErr_SetString(PyExc_TypeError, "expected a buffer of float64");
+    } else if (view.ndim == 1) {
+      a.ndim = 1;
+      a.vector_copy.resize(view.shape[0]);
+      const char *p = static_cast<const char*>(view.buf);
+      for (Py_ssize_t i = 0; i < view.shape[0]; ++i)
+        a.vector_copy[i] = *reinterpret_cast<const double*>(
+            p + i * view.strides[0]);
+      a.vector = &a.vector_copy;
+      ok = true;
+    } else if (view.ndim == 2) {
+      // Copies C ordered and strided arrays too.
+      a.ndim = 2;
+      a.matrix_copy = pml::Matrix(view.shape[0], view.shape[1]);
+      const char *p = static_cast<const char*>(view.buf);
+      for (Py_ssize_t j = 0; j < view.shape[1]; ++j)
+        for (Py_ssize_t i = 0; i < view.shape[0]; ++i)
+          a.matrix_copy(i, j) = *reinterpret_cast<const double*>(
+              p + i * view.strides[0] + j * view.strides[1]);
+      a.matrix = &a.matrix_copy;
+      ok = true;
+    } else {
+      PyErr_SetString(PyExc_ValueError, "expected a 1-D or 2-D array");
+    }
+    PyBuffer_Release(&view);
+    return ok;
+  }
+
+  bool expect_ndim(const Array &a, int ndim, const char *name) {
+    if (a.ndim != ndim) {
+      PyErr_Format(PyExc_ValueError, "%s: expected a %d-D array", name, ndim);
+      return false;
+    }
+    return true;
+  }
+
+  // ------- Vector -------
+
+  PyObject *Vector_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    PyObject *obj;
+    double value = 0;
+    static const char *kwlist[] = {"data", "value", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|d",
+                                     const_cast<char**>(kwlist), &obj, &value))
+      return NULL;
+    if (PyLong_Check(obj)) {
+      Py_ssize_t length = PyLong_AsSsize_t(obj);
+      if (length < 0) {
+        if (!PyErr_Occurred())
+          PyErr_SetString(PyExc_ValueError, "Vector: negative length");
+        return NULL;
+      }
+      try {
+        return wrap(pml::Vector(length, value));
+      } catch (const std::bad_alloc &) {
+        return PyErr_NoMemory();
+      }
+    }
+    Array a;
+    if (!to_array(obj, a) || !expect_ndim(a, 1, "Vector"))
+      return NULL;
+    return wrap(pml::Vector(*a.vector));
+  }
+
+  void Vector_dealloc(VectorObject *self) {
+    delete self->vector;
+    PyObject_Del(self);
+  }
+
+  int Vector_getbuffer(VectorObject *self, Py_buffer *view, int flags) {
+    pml::Vector &v = *self->vector;
+    self->shape[0] = v.size();
+    self->strides[0] = sizeof(double);
+    view->obj = reinterpret_cast<PyObject*>(self);
+    Py_INCREF(self);
+    ++self->exports;
+    view->buf = v.empty() ? empty_buffer : v.data();
+    view->len = sizeof(double) * v.size();
+    view->readonly = 0;
+    view->itemsize = sizeof(double);
+    view->format = (flags & PyBUF_FORMAT) ? const_cast<char*>("d") : NULL;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) == PyBUF_ND ? self->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides
+                                                            : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+  }
+
+  void Vector_releasebuffer(VectorObject *self, Py_buffer *) {
+    --self->exports;
+  }
+
+  PyObject *Vector_repr(VectorObject *self) {
+    return PyUnicode_FromFormat("Vector(size=%zd)",
+                                Py_ssize_t(self->vector->size()));
+  }
+
+  Py_ssize_t Vector_len(VectorObject *self) {
+    return self->vector->size();
+  }
+
+  PyObject *Vector_shape(VectorObject *self, void *) {
+    return Py_BuildValue("(n)", Py_ssize_t(self->vector->size()));
+  }
+
+  PyObject *Vector_save(VectorObject *self, PyObject *args) {
+    const char *filename;
+    int compression_level = 0;
+    if (!PyArg_ParseTuple(args, "s|i", &filename, &compression_level))
+      return NULL;
+    std::string name(filename);
+    bool ok;
+    int error;
+    Py_BEGIN_ALLOW_THREADS
+    errno = 0;
+    ok = self->vector->save(name, compression_level);
+    error = errno;
+    Py_END_ALLOW_THREADS
+    if (!ok)
+      return save_error(filename, error);
+    Py_RETURN_NONE;
+  }
+
+  PyObject *Vector_load(PyObject *, PyObject *args) {
+    const char *filename;
+    if (!PyArg_ParseTuple(args, "s", &filename))
+      return NULL;
+    std::string name(filename);
+    if (!pml::file_exists(name))
+      return PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    pml::Vector v;
+    const char *error = NULL;
+    bool no_memory = false;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+      error = load_array(name, 1, [&v](const std::vector<size_t> &dims){
+        v.resize(dims[0]);
+        return v.data();
+      });
+    } catch (const std::bad_alloc &) {
+      no_memory = true;
+    }
+    Py_END_ALLOW_THREADS
+    if (no_memory)
+      return PyErr_NoMemory();
+    if (error)
+      return PyErr_Format(PyExc_ValueError, "Vector.load: %s: '%s'",
+                          error, filename);
+    return wrap(std::move(v));
+  }
+
+  PyMethodDef Vector_methods[] = {
+    {"save", (PyCFunction) Vector_save, METH_VARARGS,
+     "save(filename, compression_level=0)\n"
+     "Saves in pml binary format, zlib compressed if the level is 1-9."},
+    {"load", (PyCFunction) Vector_load, METH_VARARGS | METH_STATIC,
+     "load(filename)\nLoads a Vector saved with save()."},
+    {NULL}
+  };
+
+  PyGetSetDef Vector_getset[] = {
+    {const_cast<char*>("shape"), (getter) Vector_shape, NULL, NULL, NULL},
+    {NULL}
+  };
+
+  PySequenceMethods Vector_as_sequence = {(lenfunc) Vector_len};
+
+  PyBufferProcs Vector_as_buffer = {(getbufferproc) Vector_getbuffer,
+                                    (releasebufferproc) Vector_releasebuffer};
+
+  // ------- Matrix -------
+
+  PyObject *Matrix_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    PyObject *obj;
+    Py_ssize_t ncols = -1;
+    double value = 0;
+    static const char *kwlist[] = {"data", "ncols", "value", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|nd",
+                                     const_cast<char**>(kwlist),
+                                     &obj, &ncols, &value))
+      return NULL;
+    if (PyLong_Check(obj)) {
+      Py_ssize_t nrows = PyLong_AsSsize_t(obj);
+      if (nrows < 0 || ncols < 0) {
+        if (!PyErr_Occurred())
+          PyErr_SetString(PyExc_ValueError,
+                          "Matrix: expected nrows and ncols >= 0");
+        return NULL;
+      }
+      try {
+        return wrap(pml::Matrix(nrows, ncols, value));
+      } catch (const std::bad_alloc &) {
+        return PyErr_NoMemory();
+      }
+    }
+    Array a;
+    if (!to_array(obj, a))
+      return NULL;
+    if (a.ndim == 1)
+      return wrap(pml::Matrix(a.vector->size(), 1, a.vector->data()));
+    return wrap(pml::Matrix(*a.matrix));
+  }
+
+  void Matrix_dealloc(MatrixObject *self) {
+    delete self->matrix;
+    PyObject_Del(self);
+  }
+
+  int Matrix_getbuffer(MatrixObject *self, Py_buffer *view, int flags) {
+    pml::Matrix &m = *self->matrix;
+    // Without strides the consumer assumes C order.
+    bool c_order_only = m.nrows() > 1 && m.ncols() > 1;
+    if (c_order_only &&
+        ((flags & PyBUF_C_CONTIGUOUS) == PyBUF_C_CONTIGUOUS ||
+         ((flags & PyBUF_ND) == PyBUF_ND &&
+          (flags & PyBUF_STRIDES) != PyBUF_STRIDES))) {
+      PyErr_SetString(PyExc_BufferError,
+                      "Matrix is stored in Fortran order");
+      view->obj = NULL;
+      return -1;
+    }
+    self->shape[0] = m.nrows();
+    self->shape[1] = m.ncols();
+    self->strides[0] = sizeof(double);
+    self->strides[1] = sizeof(double) * m.nrows();
+    view->obj = reinterpret_cast<PyObject*>(self);
+    Py_INCREF(self);
+    ++self->exports;
+    view->buf = m.empty() ? empty_buffer : m.data();
+    view->len = sizeof(double) * m.size();
+    view->readonly = 0;
+    view->itemsize = sizeof(double);
+    view->format = (flags & PyBUF_FORMAT) ? const_cast<char*>("d") : NULL;
+    view->ndim = 2;
+    view->shape = (flags & PyBUF_ND) == PyBUF_ND ? self->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides
+                                                            : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+  }
+
+  void Matrix_releasebuffer(MatrixObject *self, Py_buffer *) {
+    --self->exports;
+  }
+
+  PyObject *Matrix_repr(MatrixObject *self) {
+    return PyUnicode_FromFormat("Matrix(shape=(%zd, %zd))",
+                                Py_ssize_t(self->matrix->nrows()),
+                                Py_ssize_t(self->matrix->ncols()));
+  }
+
+  Py_ssize_t Matrix_len(MatrixObject *self) {
+    return self->matrix->nrows();
+  }
+
+  PyObject *Matrix_shape(MatrixObject *self, void *) {
+    return Py_BuildValue("(nn)", Py_ssize_t(self->matrix->nrows()),
+                         Py_ssize_t(self->matrix->ncols()));
+  }
+
+  PyObject *Matrix_save(MatrixObject *self, PyObject *args) {
+    const char *filename;
+    int compression_level = 0;
+    if (!PyArg_ParseTuple(args, "s|i", &filename, &compression_level))
+      return NULL;
+    std::string name(filename);
+    bool ok;
+    int error;
+    Py_BEGIN_ALLOW_THREADS
+    errno = 0;
+    ok = self->matrix->save(name, compression_level);
+    error = errno;
+    Py_END_ALLOW_THREADS
+    if (!ok)
+      return save_error(filename, error);
+    Py_RETURN_NONE;
+  }
+
+  PyObject *Matrix_load(PyObject *, PyObject *args) {
+    const char *filename;
+    if (!PyArg_ParseTuple(args, "s", &filename))
+      return NULL;
+    std::string name(filename);
+    if (!pml::file_exists(name))
+      return PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    pml::Matrix m;
+    const char *error = NULL;
+    bool no_memory = false;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+      error = load_array(name, 2, [&m](const std::vector<size_t> &dims){
+        m = pml::Matrix(dims[0], dims[1]);
+        return m.data();
+      });
+    } catch (const std::bad_alloc &) {
+      no_memory = true;
+    }
+    Py_END_ALLOW_THREADS
+    if (no_memory)
+      return PyErr_NoMemory();
+    if (error)
+      return PyErr_Format(PyExc_ValueError, "Matrix.load: %s: '%s'",
+                          error, filename);
+    return wrap(std::move(m));
+  }
+
+  PyMethodDef Matrix_methods[] = {
+    {"save", (PyCFunction) Matrix_save, METH_VARARGS,
+     "save(filename, compression_level=0)\n"
+     "Saves in pml binary format, zlib compressed if the level is 1-9."},
+    {"load", (PyCFunction) Matrix_load, METH_VARARGS | METH_STATIC,
+     "load(filename)\nLoads a Matrix saved with save()."},
+    {NULL}
+  };
+
+  PyGetSetDef Matrix_getset[] = {
+    {const_cast<char*>("shape"), (getter) Matrix_shape, NULL, NULL, NULL},
+    {NULL}
+  };
+
+  PySequenceMethods Matrix_as_sequence = {(lenfunc) Matrix_len};
+
+  PyBufferProcs Matrix_as_buffer = {(getbufferproc) Matrix_getbuffer,
+                                    (releasebufferproc) Matrix_releasebuffer};
+
+  // ------- Functions -------
+
+  PyObject *py_dot(PyObject *, PyObject *args) {
+    PyObject *x_obj, *y_obj;
+    if (!PyArg_ParseTuple(args, "OO", &x_obj, &y_obj))
+      return NULL;
+    Array x, y;
+    if (!to_array(x_obj, x) || !to_array(y_obj, y))
+      return NULL;
+    size_t x_cols = x.ndim == 1 ? x.vector->size() : x.matrix->ncols();
+    size_t y_rows = y.ndim == 1 ? y.vector->size() : y.matrix->nrows();
+    if (x_cols != y_rows) {
+      PyErr_SetString(PyExc_ValueError, "dot: shapes do not match");
+      return NULL;
+    }
+    if (x.ndim == 1 && y.ndim == 1) {
+      double result;
+      Py_BEGIN_ALLOW_THREADS
+      result = pml::dot(*x.vector, *y.vector);
+      Py_END_ALLOW_THREADS
+      return PyFloat_FromDouble(result);
+    }
+    if (x.ndim == 2 && y.ndim == 1) {
+      pml::Vector result;
+      Py_BEGIN_ALLOW_THREADS
+      result = pml::dot(*x.matrix, *y.vector);
+      Py_END_ALLOW_THREADS
+      return wrap(std::move(result));
+    }
+    if (x.ndim == 2 && y.ndim == 2) {
+      pml::Matrix result;
+      Py_BEGIN_ALLOW_THREADS
+      result = pml::dot(*x.matrix, *y.matrix);
+      Py_END_ALLOW_THREADS
+      return wrap(std::move(result));
+    }
+    PyErr_SetString(PyExc_ValueError, "dot: expected (1-D, 1-D), "
+                    "(2-D, 1-D) or (2-D, 2-D) arrays");
+    return NULL;
+  }
+
+  PyObject *py_logSumExp(PyObject *, PyObject *args, PyObject *kwds) {
+    PyObject *x_obj, *axis_obj = Py_None;
+    static const char *kwlist[] = {"x", "axis", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O",
+                                     const_cast<char**>(kwlist),
+                                     &x_obj, &axis_obj))
+      return NULL;
+    Array x;
+    if (!to_array(x_obj, x))
+      return NULL;
+    if (axis_obj == Py_None) {
+      double result;
+      Py_BEGIN_ALLOW_THREADS
+      result = x.ndim == 1 ? pml::logSumExp(*x.vector)
+                           : pml::logSumExp(*x.matrix);
+      Py_END_ALLOW_THREADS
+      return PyFloat_FromDouble(result);
+    }
+    long axis = PyLong_AsLong(axis_obj);
+    if (PyErr_Occurred() || !expect_ndim(x, 2, "logSumExp"))
+      return NULL;
+    if (axis != 0 && axis != 1) {
+      PyErr_SetString(PyExc_ValueError, "logSumExp: axis must be 0 or 1");
+      return NULL;
+    }
+    pml::Vector result;
+    Py_BEGIN_ALLOW_THREADS
+    result = pml::logSumExp(*x.matrix, axis);
+    Py_END_ALLOW_THREADS
+    return wrap(std::move(result));
+  }
+
+  PyObject *py_fitGaussian(PyObject *, PyObject *args) {
+    PyObject *data_obj;
+    if (!PyArg_ParseTuple(args, "O", &data_obj))
+      return NULL;
+    Array data;
+    if (!to_array(data_obj, data) || !expect_ndim(data, 1, "fitGaussian"))
+      return NULL;
+    pml::Gaussian result;
+    Py_BEGIN_ALLOW_THREADS
+    result = pml::Gaussian::fit(*data.vector);
+    Py_END_ALLOW_THREADS
+    return Py_BuildValue("(dd)", result.mu, result.sigma);
+  }
+
+  PyObject *py_fitGamma(PyObject *, PyObject *args) {
+    PyObject *data_obj;
+    double scale = 0;
+    if (!PyArg_ParseTuple(args, "O|d", &data_obj, &scale))
+      return NULL;
+    Array data;
+    if (!to_array(data_obj, data) || !expect_ndim(data, 1, "fitGamma"))
+      return NULL;
+    pml::Gamma result(0, 0);
+    Py_BEGIN_ALLOW_THREADS
+    result = pml::Gamma::fit(*data.vector, scale);
+    Py_END_ALLOW_THREADS
+    return Py_BuildValue("(dd)", result.a, result.b);
+  }
+
+  PyObject *py_fitDirichlet(PyObject *, PyObject *args) {
+    PyObject *data_obj;
+    double precision = 0;
+    if (!PyArg_ParseTuple(args, "O|d", &data_obj, &precision))
+      return NULL;
+    Array data;
+    if (!to_array(data_obj, data))
+      return NULL;
+    pml::Vector alpha;
+    Py_BEGIN_ALLOW_THREADS
+    alpha = data.ndim == 1
+        ? pml::Dirichlet::fit(*data.vector, precision).alpha
+        : pml::Dirichlet::fit(*data.matrix, precision).alpha;
+    Py_END_ALLOW_THREADS
+    return wrap(std::move(alpha));
+  }
+
+  PyMethodDef module_methods[] = {
+    {"dot", (PyCFunction) py_dot, METH_VARARGS,
+     "dot(x, y)\nVector-Vector, Matrix-Vector or Matrix-Matrix product."},
+    {"logSumExp", (PyCFunction)(void(*)(void)) py_logSumExp,
+     METH_VARARGS | METH_KEYWORDS,
+     "logSumExp(x, axis=None)\n"
+     "log(sum(exp(x))) of all elements, or along axis 0 or 1."},
+    {"fitGaussian", (PyCFunction) py_fitGaussian, METH_VARARGS,
+     "fitGaussian(data)\nReturns the maximum likelihood (mu, sigma)."},
+    {"fitGamma", (PyCFunction) py_fitGamma, METH_VARARGS,
+     "fitGamma(data, scale=0)\nReturns the maximum likelihood (a, b). "
+     "If scale > 0, only the shape is fitted."},
+    {"fitDirichlet", (PyCFunction) py_fitDirichlet, METH_VARARGS,
+     "fitDirichlet(data, precision=0)\nReturns alpha fitted to the columns "
+     "of a Matrix, or to a Vector of mean log probabilities."},
+    {NULL}
+  };
+
+  PyModuleDef module_def = {
+    PyModuleDef_HEAD_INIT, "_pml",
+    "Compiled pml Vector and Matrix types.", -1, module_methods
+  };
+
+  bool init_type(PyTypeObject &type, const char *name, size_t size,
+                 newfunc new_, destructor dealloc, reprfunc repr,
+                 PyMethodDef *methods, PyGetSetDef *getset,
+                 PySequenceMethods *as_sequence, PyBufferProcs *as_buffer,
+                 const char *doc) {
+    type.tp_name = name;
+    type.tp_basicsize = size;
+    type.tp_flags = Py_TPFLAGS_DEFAULT;
+    type.tp_new = new_;
+    type.tp_dealloc = dealloc;
+    type.tp_repr = repr;
+    type.tp_methods = methods;
+    type.tp_getset = getset;
+    type.tp_as_sequence = as_sequence;
+    type.tp_as_buffer = as_buffer;
+    type.tp_doc = doc;
+    return PyType_Ready(&type) == 0;
+  }
+
+} // namespace
+
+PyMODINIT_FUNC PyInit__pml(void) {
+  if (!init_type(VectorType, "pml.Vector", sizeof(VectorObject),
+                 Vector_new, (destructor) Vector_dealloc,
+                 (reprfunc) Vector_repr, Vector_methods, Vector_getset,
+                 &Vector_as_sequence, &Vector_as_buffer,
+                 "Vector(length, value=0) or Vector(array)\n"
+                 "np.asarray(v) shares memory with v.") ||
+      !init_type(MatrixType, "pml.Matrix", sizeof(MatrixObject),
+                 Matrix_new, (destructor) Matrix_dealloc,
+                 (reprfunc) Matrix_repr, Matrix_methods, Matrix_getset,
+                 &Matrix_as_sequence, &Matrix_as_buffer,
+                 "Matrix(nrows, ncols, value=0) or Matrix(array)\n"
+                 "np.asarray(m) shares memory with m, in Fortran order."))
+    return NULL;
+  PyObject *module = PyModule_Create(&module_def);
+  if (!module)
+    return NULL;
+  Py_INCREF(&VectorType);
+  Py_INCREF(&MatrixType);
+  if (PyModule_AddObject(module, "Vector",
+                         reinterpret_cast<PyObject*>(&VectorType)) != 0 ||
+      PyModule_AddObject(module, "Matrix",
+                         reinterpret_cast<PyObject*>(&MatrixType)) != 0) {
+    Py_DECREF(module);
+    return NULL;
+  }
+  return module;
+}
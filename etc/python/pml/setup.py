@@ -1,10 +1,24 @@
-from distutils.core import setup
+import os
+from distutils.core import setup, Extension
+
+include_dir = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                           '..', '..', '..', 'include')
+
+pml_extension = Extension(
+    'pml._pml',
+    sources=['pml/_pml.cc'],
+    include_dirs=[include_dir],
+    libraries=['gsl', 'gslcblas', 'z', 'pthread'],
+    extra_compile_args=['-std=c++11', '-O3'],
+    language='c++'
+)
 
 setup(
     name='pml', 
-    version='1.0', 
+    version='1.1', 
     author='Baris Kurt', 
     author_email='bariskurt@gmail.com', 
     url='www.bariskurt.com',
-    packages=['pml']
+    packages=['pml'],
+    ext_modules=[pml_extension]
 )
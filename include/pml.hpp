@@ -2,9 +2,14 @@
 #define PML_H_
 
 #include "pml_vector.hpp"
+#include "pml_csv.hpp"
 #include "pml_histogram.hpp"
 #include "pml_matrix.hpp"
+#include "pml_numpy.hpp"
+#include "pml_pipeline.hpp"
+#include "pml_qmc.hpp"
 #include "pml_random.hpp"
+#include "pml_shm.hpp"
 #include "pml_special.hpp"
 #include "pml_time.hpp"
 #include "pml_utils.hpp"
@@ -0,0 +1,312 @@
+#ifndef PML_COMPRESS_H_
+#define PML_COMPRESS_H_
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// PMLZ needs zlib (link with -lz). Compile with -DPML_WITH_ZLIB=0 to drop
+// the dependency; compressed files can then be neither written nor read.
+#ifndef PML_WITH_ZLIB
+#define PML_WITH_ZLIB 1
+#endif
+
+#if PML_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include "pml_parallel.hpp"
+
+namespace pml {
+
+  // Block compressed binary format for double arrays (PMLZ).
+  //
+  // Layout of a PMLZ file:
+  //   char[4]   magic "PMLZ"
+  //   uint32_t  version
+  //   uint32_t  flags (PMLZ_SHUFFLE)
+  //   uint32_t  number of dimensions D
+  //   uint64_t  D dimension sizes
+  //   uint64_t  block length in elements
+  //   uint64_t  number of blocks B
+  //   uint64_t  B compressed block sizes in bytes (the block index)
+  //   ...       B independent zlib streams
+  //
+  // Since the blocks are independent, they are compressed and decompressed
+  // in parallel, and any range of elements can be read by decompressing
+  // only the blocks that cover it.
+
+  const char PMLZ_MAGIC[4] = {'P', 'M', 'L', 'Z'};
+  const uint32_t PMLZ_VERSION = 1;
+  const uint32_t PMLZ_SHUFFLE = 1;
+  const size_t PMLZ_BLOCK_SIZE = 1 << 16;
+
+  // Stores the k'th bytes of all n doubles contiguously. Sign, exponent and
+  // high mantissa bytes of similar values then form long runs, which zlib
+  // compresses much better than interleaved doubles.
+  inline void byte_shuffle(const double *src, size_t n, unsigned char *dst) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(src);
+    for (size_t k = 0; k < sizeof(double); ++k)
+      for (size_t i = 0; i < n; ++i)
+        dst[k * n + i] = bytes[i * sizeof(double) + k];
+  }
+
+  inline void byte_unshuffle(const unsigned char *src, size_t n, double *dst) {
+    unsigned char *bytes = reinterpret_cast<unsigned char*>(dst);
+    for (size_t k = 0; k < sizeof(double); ++k)
+      for (size_t i = 0; i < n; ++i)
+        bytes[i * sizeof(double) + k] = src[k * n + i];
+  }
+
+#if PML_WITH_ZLIB
+  // Compresses n doubles into dst. Returns false on zlib failure.
+  inline bool pmlz_compress_block(const double *src, size_t n, int level,
+                                  bool shuffle, std::vector<unsigned char> &dst) {
+    const unsigned char *input = reinterpret_cast<const unsigned char*>(src);
+    std::vector<unsigned char> shuffled;
+    if (shuffle) {
+      shuffled.resize(n * sizeof(double));
+      byte_shuffle(src, n, shuffled.data());
+      input = shuffled.data();
+    }
+    uLongf dst_size = compressBound(n * sizeof(double));
+    dst.resize(dst_size);
+    if (compress2(dst.data(), &dst_size, input, n * sizeof(double),
+                  level) != Z_OK)
+      return false;
+    dst.resize(dst_size);
+    return true;
+  }
+
+  // Decompresses a block of exactly n doubles into dst.
+  inline bool pmlz_decompress_block(const unsigned char *src, size_t src_size,
+                                    size_t n, bool shuffle, double *dst) {
+    uLongf dst_size = n * sizeof(double);
+    if (!shuffle) {
+      return uncompress(reinterpret_cast<unsigned char*>(dst), &dst_size,
+                        src, src_size) == Z_OK &&
+             dst_size == n * sizeof(double);
+    }
+    std::vector<unsigned char> shuffled(n * sizeof(double));
+    if (uncompress(shuffled.data(), &dst_size, src, src_size) != Z_OK ||
+        dst_size != n * sizeof(double))
+      return false;
+    byte_unshuffle(shuffled.data(), n, dst);
+    return true;
+  }
+#else
+  // Without zlib every block fails, so pmlz_save returns false and
+  // PmlzReader::read reports an error.
+  inline bool pmlz_compress_block(const double *, size_t, int, bool,
+                                  std::vector<unsigned char> &) {
+    return false;
+  }
+
+  inline bool pmlz_decompress_block(const unsigned char *, size_t, size_t,
+                                    bool, double *) {
+    return false;
+  }
+#endif
+
+  // Writes the array 'data' with shape 'dims' to a PMLZ file.
+  // Blocks are compressed in parallel, a batch at a time, so the memory
+  // overhead is bounded by a few blocks per thread. 'level' is the zlib
+  // compression level, from 1 (fastest) to 9 (smallest).
+  inline bool pmlz_save(const std::string &filename,
+                        const std::vector<size_t> &dims, const double *data,
+                        int level = 1, bool shuffle = true,
+                        size_t block_size = PMLZ_BLOCK_SIZE) {
+    std::ofstream ofs(filename, std::ios::binary | std::ios::out);
+    if (!ofs.is_open())
+      return false;
+    uint64_t length = 1;
+    for (size_t d : dims)
+      length *= d;
+    uint64_t num_blocks = (length + block_size - 1) / block_size;
+
+    // Header
+    uint32_t version = PMLZ_VERSION;
+    uint32_t flags = shuffle ? PMLZ_SHUFFLE : 0;
+    uint32_t ndims = dims.size();
+    uint64_t block_length = block_size;
+    ofs.write(PMLZ_MAGIC, sizeof(PMLZ_MAGIC));
+    ofs.write(reinterpret_cast<char*>(&version), sizeof(version));
+    ofs.write(reinterpret_cast<char*>(&flags), sizeof(flags));
+    ofs.write(reinterpret_cast<char*>(&ndims), sizeof(ndims));
+    for (size_t d : dims) {
+      uint64_t dim = d;
+      ofs.write(reinterpret_cast<char*>(&dim), sizeof(dim));
+    }
+    ofs.write(reinterpret_cast<char*>(&block_length), sizeof(block_length));
+    ofs.write(reinterpret_cast<char*>(&num_blocks), sizeof(num_blocks));
+
+    // The block index is filled in after the blocks are written.
+    std::streampos index_pos = ofs.tellp();
+    std::vector<uint64_t> index(num_blocks);
+    ofs.write(reinterpret_cast<char*>(index.data()),
+              sizeof(uint64_t) * num_blocks);
+
+    size_t batch_size = 4 * get_num_threads();
+    std::vector<std::vector<unsigned char>> buffers(batch_size);
+    bool ok = true;
+    for (size_t first = 0; first < num_blocks && ok; first += batch_size) {
+      size_t count = std::min<size_t>(batch_size, num_blocks - first);
+      std::vector<char> status(count, 1);
+      parallel_for(count, 1, [&](size_t start, size_t stop) {
+        for (size_t i = start; i < stop; ++i) {
+          size_t offset = (first + i) * block_size;
+          size_t n = std::min<size_t>(block_size, length - offset);
+          status[i] = pmlz_compress_block(data + offset, n, level, shuffle,
+                                          buffers[i]);
+        }
+      });
+      for (size_t i = 0; i < count; ++i) {
+        ok = ok && status[i];
+        index[first + i] = buffers[i].size();
+        ofs.write(reinterpret_cast<char*>(buffers[i].data()),
+                  buffers[i].size());
+      }
+    }
+    ofs.seekp(index_pos);
+    ofs.write(reinterpret_cast<char*>(index.data()),
+              sizeof(uint64_t) * num_blocks);
+    return ok && ofs.good();
+  }
+
+  // Random access reader for PMLZ files.
+  class PmlzReader {
+    public:
+      explicit PmlzReader(const std::string &filename)
+          : ifs(filename, std::ios::binary | std::ios::in), open_(false),
+            shuffle(false), block_size(0), length(0), cached_block(-1) {
+        char magic[4];
+        if (!ifs.read(magic, sizeof(magic)) ||
+            memcmp(magic, PMLZ_MAGIC, sizeof(magic)) != 0)
+          return;
+        uint32_t version, flags, ndims;
+        ifs.read(reinterpret_cast<char*>(&version), sizeof(version));
+        ifs.read(reinterpret_cast<char*>(&flags), sizeof(flags));
+        ifs.read(reinterpret_cast<char*>(&ndims), sizeof(ndims));
+        if (!ifs || version != PMLZ_VERSION)
+          return;
+        shuffle = flags & PMLZ_SHUFFLE;
+        length = 1;
+        for (uint32_t i = 0; i < ndims; ++i) {
+          uint64_t dim;
+          ifs.read(reinterpret_cast<char*>(&dim), sizeof(dim));
+          dims_.push_back(dim);
+          length *= dim;
+        }
+        uint64_t num_blocks;
+        ifs.read(reinterpret_cast<char*>(&block_size), sizeof(block_size));
+        ifs.read(reinterpret_cast<char*>(&num_blocks), sizeof(num_blocks));
+        if (!ifs || block_size == 0 ||
+            num_blocks != (length + block_size - 1) / block_size)
+          return;
+        std::vector<uint64_t> sizes(num_blocks);
+        ifs.read(reinterpret_cast<char*>(sizes.data()),
+                 sizeof(uint64_t) * num_blocks);
+        // Block offsets relative to the file start.
+        offsets.resize(num_blocks + 1);
+        offsets[0] = ifs.tellg();
+        for (size_t i = 0; i < num_blocks; ++i)
+          offsets[i+1] = offsets[i] + sizes[i];
+        open_ = ifs.good();
+      }
+
+      // True if the file is a valid PMLZ file.
+      bool is_open() const {
+        return open_;
+      }
+
+      const std::vector<size_t>& dims() const {
+        return dims_;
+      }
+
+      // Total number of elements.
+      size_t size() const {
+        return length;
+      }
+
+      // Reads elements [start, start + count) into out, decompressing only
+      // the blocks that overlap the range. The last block is kept when only
+      // part of it is read, so reading consecutive ranges decompresses each
+      // block once.
+      bool read(size_t start, size_t count, double *out) {
+        if (!open_ || start + count > length)
+          return false;
+        if (count == 0)
+          return true;
+        size_t first_block = start / block_size;
+        size_t last_block = (start + count - 1) / block_size;
+        size_t batch_size = 4 * get_num_threads();
+        std::vector<unsigned char> compressed;
+        std::vector<double> last;
+        for (size_t first = first_block; first <= last_block;
+             first += batch_size) {
+          size_t num = std::min(batch_size, last_block + 1 - first);
+          compressed.resize(offsets[first + num] - offsets[first]);
+          ifs.seekg(offsets[first]);
+          if (!ifs.read(reinterpret_cast<char*>(compressed.data()),
+                        compressed.size()))
+            return false;
+          std::vector<char> status(num, 1);
+          parallel_for(num, 1, [&](size_t lo, size_t hi) {
+            std::vector<double> buffer;
+            for (size_t i = lo; i < hi; ++i) {
+              size_t block = first + i;
+              size_t block_start = block * block_size;
+              size_t n = std::min<size_t>(block_size, length - block_start);
+              size_t copy_start = std::max(start, block_start);
+              size_t copy_stop = std::min(start + count, block_start + n);
+              const unsigned char *src =
+                  compressed.data() + offsets[block] - offsets[first];
+              size_t src_size = offsets[block+1] - offsets[block];
+              if (copy_start == block_start && copy_stop == block_start + n) {
+                // Whole block is requested: decompress in place.
+                status[i] = pmlz_decompress_block(src, src_size, n, shuffle,
+                                                  out + block_start - start);
+              } else {
+                std::vector<double> &values =
+                    block == cached_block ? cache :
+                    block == last_block ? last : buffer;
+                if (block != cached_block) {
+                  values.resize(n);
+                  status[i] = pmlz_decompress_block(src, src_size, n, shuffle,
+                                                    values.data());
+                }
+                memcpy(out + copy_start - start,
+                       values.data() + copy_start - block_start,
+                       sizeof(double) * (copy_stop - copy_start));
+              }
+            }
+          });
+          for (char s : status)
+            if (!s)
+              return false;
+        }
+        if (!last.empty()) {
+          cache.swap(last);
+          cached_block = last_block;
+        }
+        return true;
+      }
+
+    private:
+      std::ifstream ifs;
+      bool open_;
+      bool shuffle;
+      uint64_t block_size;
+      uint64_t length;
+      std::vector<size_t> dims_;
+      std::vector<uint64_t> offsets;
+      // Last partially read block.
+      size_t cached_block;
+      std::vector<double> cache;
+  };
+
+} // namespace pml
+
+#endif // PML_COMPRESS_H_
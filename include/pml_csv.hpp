@@ -0,0 +1,190 @@
+#ifndef PML_CSV_H_
+#define PML_CSV_H_
+
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "pml_matrix.hpp"
+#include "pml_parallel.hpp"
+#include "pml_utils.hpp"
+
+namespace pml {
+
+  struct CsvOptions {
+    CsvOptions(char delimiter_ = ',', bool header_ = false)
+        : delimiter(delimiter_), header(header_) {}
+
+    // Field separator, e.g. ',' for CSV or '\t' for TSV.
+    char delimiter;
+
+    // Skip the first line.
+    bool header;
+
+    // Columns to read, in the order they appear in the result. A column
+    // may be listed more than once. Empty means all columns.
+    std::vector<size_t> columns;
+
+    // Columns to leave out. Ignored if 'columns' is given.
+    std::vector<size_t> skip;
+  };
+
+  // Parses one field. Empty fields, "NA", "nan", "null" and anything else
+  // that is not a number become NaN.
+  inline double csv_parse_field(const char *begin, const char *end) {
+    while (begin < end && (*begin == ' ' || *begin == '"'))
+      ++begin;
+    while (end > begin && (end[-1] == ' ' || end[-1] == '"' || end[-1] == '\r'))
+      --end;
+    size_t length = end - begin;
+    if (length == 0)
+      return std::numeric_limits<double>::quiet_NaN();
+    // The mapped file is not null terminated, so copy to a local buffer,
+    // or to a string for unusually long fields.
+    char local[64];
+    std::string copy;
+    const char *buffer = local;
+    if (length < sizeof(local)) {
+      memcpy(local, begin, length);
+      local[length] = 0;
+    } else {
+      copy.assign(begin, end);
+      buffer = copy.c_str();
+    }
+    char *stop;
+    double value = strtod(buffer, &stop);
+    if (stop != buffer + length)
+      return std::numeric_limits<double>::quiet_NaN();
+    return value;
+  }
+
+  // Returns the first character of the line after p.
+  inline const char *csv_next_line(const char *p, const char *end) {
+    const char *newline =
+        static_cast<const char*>(memchr(p, '\n', end - p));
+    return newline ? newline + 1 : end;
+  }
+
+  // Checks whether the line [p, end of line) has only whitespace.
+  inline bool csv_blank_line(const char *p, const char *end) {
+    for (; p < end && *p != '\n'; ++p)
+      if (*p != ' ' && *p != '\r' && *p != '\t')
+        return false;
+    return true;
+  }
+
+  // Loads a CSV or TSV file into a Matrix with one row per line.
+  //
+  // The file is memory mapped and split into chunks at line boundaries.
+  // A first parallel pass counts the lines of each chunk, which gives the
+  // Matrix size and the first row of every chunk. A second parallel pass
+  // parses the chunks directly into the column major storage.
+  // Quoted fields may not contain delimiters or newlines.
+  inline Matrix loadCsv(const std::string &filename,
+                        const CsvOptions &options = CsvOptions()) {
+    MemoryMap file(filename);
+    if (!file.is_open())
+      return Matrix();
+    const char *begin = file.data();
+    const char *end = begin + file.size();
+    if (options.header)
+      begin = csv_next_line(begin, end);
+    while (begin < end && csv_blank_line(begin, end))
+      begin = csv_next_line(begin, end);
+    if (begin == end)
+      return Matrix();
+
+    // Map file columns to Matrix columns using the first line.
+    size_t num_fields = 1;
+    for (const char *p = begin; p < end && *p != '\n'; ++p)
+      num_fields += (*p == options.delimiter);
+    std::vector<long> target(num_fields, -1);
+    // Repeated columns are parsed once and copied: (from, to) pairs.
+    std::vector<std::pair<size_t, size_t>> copies;
+    size_t ncols = 0;
+    if (!options.columns.empty()) {
+      for (size_t column : options.columns) {
+        ASSERT_TRUE(column < num_fields, "loadCsv:: Column out of bounds.");
+        if (target[column] >= 0)
+          copies.push_back({size_t(target[column]), ncols++});
+        else
+          target[column] = ncols++;
+      }
+    } else {
+      for (size_t column = 0; column < num_fields; ++column) {
+        if (std::find(options.skip.begin(), options.skip.end(), column) ==
+            options.skip.end())
+          target[column] = ncols++;
+      }
+    }
+
+    // Split into chunks that start at a line.
+    size_t chunk_size = std::max<size_t>(1 << 20,
+        (end - begin) / (4 * get_num_threads()) + 1);
+    std::vector<const char*> chunks = {begin};
+    while (chunks.back() < end) {
+      const char *p = chunks.back() + std::min<size_t>(chunk_size,
+                                                       end - chunks.back());
+      chunks.push_back(p < end ? csv_next_line(p - 1, end) : end);
+    }
+    size_t num_chunks = chunks.size() - 1;
+
+    // First pass: count the non-blank lines of each chunk.
+    std::vector<size_t> first_row(num_chunks + 1, 0);
+    parallel_for(num_chunks, 1, [&](size_t start, size_t stop) {
+      for (size_t i = start; i < stop; ++i) {
+        size_t lines = 0;
+        for (const char *p = chunks[i]; p < chunks[i+1];
+             p = csv_next_line(p, chunks[i+1]))
+          lines += !csv_blank_line(p, chunks[i+1]);
+        first_row[i+1] = lines;
+      }
+    });
+    for (size_t i = 0; i < num_chunks; ++i)
+      first_row[i+1] += first_row[i];
+
+    // Second pass: parse the fields into the Matrix.
+    size_t nrows = first_row[num_chunks];
+    Matrix result(nrows, ncols, std::numeric_limits<double>::quiet_NaN());
+    double *data = result.data();
+    parallel_for(num_chunks, 1, [&](size_t start, size_t stop) {
+      for (size_t i = start; i < stop; ++i) {
+        size_t row = first_row[i];
+        for (const char *p = chunks[i]; p < chunks[i+1]; ) {
+          const char *line_end = csv_next_line(p, chunks[i+1]);
+          if (csv_blank_line(p, line_end)) {
+            p = line_end;
+            continue;
+          }
+          if (line_end > p && line_end[-1] == '\n')
+            --line_end;
+          size_t field = 0;
+          while (field < num_fields) {
+            const char *field_end = static_cast<const char*>(
+                memchr(p, options.delimiter, line_end - p));
+            if (!field_end)
+              field_end = line_end;
+            if (target[field] >= 0)
+              data[row + nrows * target[field]] =
+                  csv_parse_field(p, field_end);
+            ++field;
+            if (field_end == line_end)
+              break;
+            p = field_end + 1;
+          }
+          p = csv_next_line(line_end, chunks[i+1]);
+          ++row;
+        }
+      }
+    });
+    for (auto &copy : copies)
+      std::copy(data + nrows * copy.first, data + nrows * (copy.first + 1),
+                data + nrows * copy.second);
+    return result;
+  }
+
+} // namespace pml
+
+#endif // PML_CSV_H_
@@ -1,6 +1,8 @@
 #ifndef PML_MATRIX_H_
 #define PML_MATRIX_H_
 
+#include <memory>
+
 #include "pml_vector.hpp"
 
 extern "C" {
@@ -644,17 +646,27 @@ namespace pml {
         return in;
       }
 
-      void save(const std::string &filename){
+      // Saves the Matrix in binary format. If compression_level is in [1, 9],
+      // the data is zlib compressed in blocks (see pml_compress.hpp) and
+      // optionally byte shuffled first.
+      // Returns false if the file could not be written.
+      bool save(const std::string &filename, int compression_level = 0,
+                bool shuffle = true) const {
+        if (compression_level > 0)
+          return pmlz_save(filename, {nrows(), ncols()}, data(),
+                           compression_level, shuffle);
         std::ofstream ofs(filename, std::ios::binary | std::ios::out);
-        if (ofs.is_open()) {
-          double dim = 2;
-          double dim1 = nrows(), dim2 = ncols();
-          ofs.write(reinterpret_cast<char*>(&dim), sizeof(double));
-          ofs.write(reinterpret_cast<char*>(&dim1), sizeof(double));
-          ofs.write(reinterpret_cast<char*>(&dim2), sizeof(double));
-          ofs.write(reinterpret_cast<char*>(data()), sizeof(double)*size());
-          ofs.close();
-        }
+        if (!ofs.is_open())
+          return false;
+        double dim = 2;
+        double dim1 = nrows(), dim2 = ncols();
+        ofs.write(reinterpret_cast<char*>(&dim), sizeof(double));
+        ofs.write(reinterpret_cast<char*>(&dim1), sizeof(double));
+        ofs.write(reinterpret_cast<char*>(&dim2), sizeof(double));
+        ofs.write(reinterpret_cast<const char*>(data()),
+                  sizeof(double)*size());
+        ofs.close();
+        return ofs.good();
       }
 
       void saveTxt(const std::string &filename) const {
@@ -669,8 +681,18 @@ namespace pml {
         }
       }
 
+      // Loads a Matrix saved with save(), compressed or not.
       static Matrix load(const std::string &filename){
         Matrix result;
+        PmlzReader reader(filename);
+        if (reader.is_open()) {
+          ASSERT_TRUE(reader.dims().size() == 2,
+                      "Matrix::load:: Dimension mismatch.");
+          result.reshape(reader.dims()[0], reader.dims()[1]);
+          ASSERT_TRUE(reader.read(0, result.size(), result.data()),
+                      "Matrix::load:: Corrupted file.");
+          return result;
+        }
         std::ifstream ifs(filename, std::ios::binary | std::ios::in);
         if (ifs.is_open()) {
           double dim, nrows, ncols;
@@ -686,6 +708,53 @@ namespace pml {
         return result;
       }
 
+      // Loads only the given columns of a Matrix saved with save(). For
+      // compressed files, only the blocks holding these columns are read,
+      // each of them once.
+      static Matrix loadColumns(const std::string &filename, Range range){
+        Matrix result;
+        PmlzReader reader(filename);
+        if (reader.is_open()) {
+          ASSERT_TRUE(reader.dims().size() == 2,
+                      "Matrix::loadColumns:: Dimension mismatch.");
+          size_t nrows = reader.dims()[0];
+          size_t count = range.start < range.stop ?
+              (range.stop - range.start + range.step - 1) / range.step : 0;
+          result.reshape(nrows, count);
+          for(size_t j = 0; j < count; ++j){
+            size_t i = range.start + j * range.step;
+            ASSERT_TRUE(i < reader.dims()[1],
+                        "Matrix::loadColumns:: Column out of bounds.");
+            double *column = result.data() + j * nrows;
+            ASSERT_TRUE(reader.read(i * nrows, nrows, column),
+                        "Matrix::loadColumns:: Corrupted file.");
+          }
+          return result;
+        }
+        std::ifstream ifs(filename, std::ios::binary | std::ios::in);
+        if (ifs.is_open()) {
+          double header[3];
+          ifs.read(reinterpret_cast<char*>(header), sizeof(header));
+          ASSERT_TRUE(header[0] == 2, "Matrix::loadColumns:: Dimension mismatch.");
+          ASSERT_TRUE(ifs.good(), "Matrix::loadColumns:: Corrupted file.");
+          size_t nrows = header[1], ncols = header[2];
+          size_t count = range.start < range.stop ?
+              (range.stop - range.start + range.step - 1) / range.step : 0;
+          result.reshape(nrows, count);
+          for(size_t j = 0; j < count; ++j){
+            size_t i = range.start + j * range.step;
+            ASSERT_TRUE(i < ncols,
+                        "Matrix::loadColumns:: Column out of bounds.");
+            ifs.seekg(sizeof(header) + sizeof(double) * i * nrows);
+            ifs.read(reinterpret_cast<char*>(result.data() + j * nrows),
+                     sizeof(double) * nrows);
+            ASSERT_TRUE(ifs.good(), "Matrix::loadColumns:: Corrupted file.");
+          }
+          ifs.close();
+        }
+        return result;
+      }
+
       static Matrix loadTxt(const std::string &filename) {
         Matrix result;
         std::ifstream ifs(filename);
@@ -826,6 +895,15 @@ namespace pml {
         }
       }
 
+      // Accumulates other in log space, this = log(exp(this) + exp(other)).
+      void logAddExp(const Matrix &other){
+        ASSERT_TRUE(shape() == other.shape(),
+                    "Matrix::logAddExp:: Size mismatch.");
+        parallel_for(size(), 1 << 14, [&](size_t start, size_t stop){
+          pml::logAddExp(data() + start, other.data() + start, stop - start);
+        });
+      }
+
     private:
       size_t nrows_;
       size_t ncols_;
@@ -833,6 +911,90 @@ namespace pml {
 
   };
 
+  // Read-only view of a column-major matrix stored elsewhere, e.g. in a
+  // memory mapped file or in shared memory. The view keeps 'owner' alive,
+  // so the storage outlives every copy of the view.
+  class MatrixView {
+    public:
+      MatrixView() : nrows_(0), ncols_(0), data_(nullptr) {}
+
+      MatrixView(size_t num_rows, size_t num_cols, const double *values,
+                 std::shared_ptr<const void> owner_ = nullptr)
+          : nrows_(num_rows), ncols_(num_cols), data_(values),
+            owner(owner_) {}
+
+      // View of a Matrix. The Matrix must outlive the view.
+      explicit MatrixView(const Matrix &m)
+          : nrows_(m.nrows()), ncols_(m.ncols()), data_(m.data()) {}
+
+    public:
+      size_t nrows() const{
+        return nrows_;
+      }
+
+      size_t ncols() const{
+        return ncols_;
+      }
+
+      size_t size() const{
+        return nrows_ * ncols_;
+      }
+
+      std::pair<size_t, size_t> shape() const{
+        return {nrows_, ncols_};
+      };
+
+      bool empty() const {
+        return size() == 0;
+      }
+
+      const double *begin() const {
+        return data_;
+      }
+
+      const double *end() const {
+        return data_ + size();
+      }
+
+      const double *data() const {
+        return data_;
+      }
+
+      inline double operator[](const size_t i0) const {
+        return data_[i0];
+      }
+
+      inline double operator()(const size_t i0) const {
+        return data_[i0];
+      }
+
+      inline double operator()(const size_t i0, const size_t i1) const {
+        return data_[i0 + nrows_ * i1];
+      }
+
+      Vector getColumn(size_t col_num) const {
+        return Vector(nrows_, data_ + col_num * nrows_);
+      }
+
+      Vector getRow(size_t row_num) const {
+        Vector row(ncols_);
+        for(size_t i=0; i < ncols_; ++i)
+          row(i) = data_[row_num + i * nrows_];
+        return row;
+      }
+
+      // Copies the viewed data into a Matrix.
+      Matrix copy() const {
+        return Matrix(nrows_, ncols_, data_);
+      }
+
+    private:
+      size_t nrows_;
+      size_t ncols_;
+      const double *data_;
+      std::shared_ptr<const void> owner;
+  };
+
   // Concatanate two matrices as in Matlab
   inline Matrix cat(const Matrix &m1, const Matrix &m2, size_t axis = 1){
     Matrix result(m1);
@@ -1060,6 +1222,122 @@ namespace pml {
     return result;
   }
 
+  // Safe log(exp(x) + exp(y)), elementwise.
+  inline Matrix logAddExp(const Matrix &x, const Matrix &y) {
+    Matrix result(x);
+    result.logAddExp(y);
+    return result;
+  }
+
+  // Log semiring product of the M x K array A and the K x N array B, both
+  // column major: C = log(exp(A) * exp(B)) without overflow or underflow.
+  // If A_transpose is set, A is stored as its K x M transpose.
+  //
+  // K is split into blocks. Within a block the rows of A and the columns
+  // of B are shifted by their maxima, exponentiated and multiplied with
+  // GEMM, and the block results are accumulated with logAddExp. Entries
+  // whose shifted sum is too small to be accurate, because the maxima
+  // come from different k, are recomputed directly.
+  inline void log_dot(const double *A, const double *B,
+                      size_t M, size_t K, size_t N, double *C,
+                      bool A_transpose = false) {
+    const size_t BLOCK = 256;
+    // A(i, k) is A[i * a_row + k * a_col].
+    const size_t a_row = A_transpose ? K : 1, a_col = A_transpose ? 1 : M;
+    const double inf = std::numeric_limits<double>::infinity();
+    const double tiny = 1e-200;
+    std::fill(C, C + M * N, -inf);
+    std::vector<double> a_max(M), b_max(N), EA, EB, S(M * N);
+    for (size_t k0 = 0; k0 < K; k0 += BLOCK) {
+      size_t kb = std::min(BLOCK, K - k0);
+      EA.resize(M * kb);
+      EB.resize(kb * N);
+      std::fill(a_max.begin(), a_max.end(), -inf);
+      for (size_t k = 0; k < kb; ++k)
+        for (size_t i = 0; i < M; ++i)
+          a_max[i] = std::max(a_max[i], A[i * a_row + (k0 + k) * a_col]);
+      parallel_for(N, 16, [&](size_t start, size_t stop) {
+        for (size_t j = start; j < stop; ++j) {
+          const double *b = B + j * K + k0;
+          b_max[j] = *std::max_element(b, b + kb);
+          double shift = std::isfinite(b_max[j]) ? b_max[j] : 0;
+          for (size_t k = 0; k < kb; ++k)
+            EB[k + j * kb] = std::exp(b[k] - shift);
+        }
+      });
+      // EA has the layout of A: M x kb, or kb x M if transposed.
+      if (A_transpose) {
+        parallel_for(M, 16, [&](size_t start, size_t stop) {
+          for (size_t i = start; i < stop; ++i) {
+            double shift = std::isfinite(a_max[i]) ? a_max[i] : 0;
+            for (size_t k = 0; k < kb; ++k)
+              EA[k + i * kb] = std::exp(A[k0 + k + i * K] - shift);
+          }
+        });
+      } else {
+        parallel_for(kb, 16, [&](size_t start, size_t stop) {
+          for (size_t k = start; k < stop; ++k)
+            for (size_t i = 0; i < M; ++i) {
+              double shift = std::isfinite(a_max[i]) ? a_max[i] : 0;
+              EA[i + k * M] = std::exp(A[i + (k0 + k) * M] - shift);
+            }
+        });
+      }
+      cblas_dgemm(CblasColMajor, A_transpose ? CblasTrans : CblasNoTrans,
+                  CblasNoTrans, M, N, kb, 1.0, EA.data(), A_transpose ? kb : M,
+                  EB.data(), kb, 0.0, S.data(), M);
+      parallel_for(N, 16, [&](size_t start, size_t stop) {
+        for (size_t j = start; j < stop; ++j) {
+          for (size_t i = 0; i < M; ++i) {
+            double term;
+            if (a_max[i] == -inf || b_max[j] == -inf) {
+              continue;
+            } else if (std::isfinite(a_max[i]) && std::isfinite(b_max[j]) &&
+                       S[i + j * M] >= tiny) {
+              term = a_max[i] + b_max[j] + std::log(S[i + j * M]);
+            } else {
+              double max_term = -inf;
+              for (size_t k = k0; k < k0 + kb; ++k)
+                max_term = std::max(max_term,
+                                    A[i * a_row + k * a_col] + B[k + j * K]);
+              if (!std::isfinite(max_term)) {
+                term = max_term;
+              } else {
+                double sum = 0;
+                for (size_t k = k0; k < k0 + kb; ++k)
+                  sum += std::exp(A[i * a_row + k * a_col] + B[k + j * K] -
+                                  max_term);
+                term = max_term + std::log(sum);
+              }
+            }
+            C[i + j * M] = logAddExp(C[i + j * M], term);
+          }
+        }
+      });
+    }
+  }
+
+  // log(exp(A) * exp(B))
+  inline Matrix logDot(const Matrix &A, const Matrix &B) {
+    ASSERT_TRUE(A.ncols() == B.nrows(), "logDot:: Size mismatch.");
+    Matrix result(A.nrows(), B.ncols());
+    log_dot(A.data(), B.data(), A.nrows(), A.ncols(), B.ncols(),
+            result.data());
+    return result;
+  }
+
+  // log(exp(A) * exp(x)), or log(exp(A)' * exp(x)) if A_transpose is set,
+  // e.g. the forward recursion of an HMM with log transition matrix A.
+  inline Vector logDot(const Matrix &A, const Vector &x,
+                       bool A_transpose = false) {
+    size_t M = A_transpose ? A.ncols() : A.nrows();
+    size_t K = A_transpose ? A.nrows() : A.ncols();
+    ASSERT_TRUE(K == x.size(), "logDot:: Size mismatch.");
+    Vector result(M);
+    log_dot(A.data(), x.data(), M, K, 1, result.data(), A_transpose);
+    return result;
+  }
+
 } // namespace pml
 
 #endif // PML_MATRIX_H_
\ No newline at end of file
@@ -0,0 +1,500 @@
+#ifndef PML_NUMPY_H_
+#define PML_NUMPY_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "pml_matrix.hpp"
+#include "pml_utils.hpp"
+
+namespace pml {
+
+  // ------- NumPy .npy format -------
+  //
+  // An .npy file starts with the magic string "\x93NUMPY", a version, the
+  // header length and a Python dict literal such as
+  //   {'descr': '<f8', 'fortran_order': True, 'shape': (3, 4), }
+  // padded with spaces so that the array data starts at a multiple of 64
+  // bytes. pml matrices are column major, i.e. in NumPy's Fortran order, so
+  // they are written, read and memory mapped without a transpose.
+
+  struct NpyHeader {
+    std::string descr;
+    bool fortran_order;
+    std::vector<size_t> shape;
+    size_t data_offset;   // Number of bytes before the array data.
+
+    size_t length() const {
+      size_t n = 1;
+      for (size_t d : shape)
+        n *= d;
+      return n;
+    }
+  };
+
+  // Little endian integer readers for the npy and zip headers.
+  inline uint16_t read_le16(const char *p) {
+    const unsigned char *u = reinterpret_cast<const unsigned char*>(p);
+    return u[0] | (u[1] << 8);
+  }
+
+  inline uint32_t read_le32(const char *p) {
+    return read_le16(p) | (uint32_t(read_le16(p + 2)) << 16);
+  }
+
+  inline uint64_t read_le64(const char *p) {
+    return read_le32(p) | (uint64_t(read_le32(p + 4)) << 32);
+  }
+
+  inline void write_le16(std::string &out, uint16_t value) {
+    out.push_back(char(value & 0xff));
+    out.push_back(char(value >> 8));
+  }
+
+  inline void write_le32(std::string &out, uint32_t value) {
+    write_le16(out, value & 0xffff);
+    write_le16(out, value >> 16);
+  }
+
+  // Parses the npy header at the beginning of buffer.
+  inline bool npy_parse_header(const char *buffer, size_t size,
+                               NpyHeader &header) {
+    if (size < 10 || memcmp(buffer, "\x93" "NUMPY", 6) != 0)
+      return false;
+    size_t prefix, dict_size;
+    if (buffer[6] == 1) {
+      prefix = 10;
+      dict_size = read_le16(buffer + 8);
+    } else if ((buffer[6] == 2 || buffer[6] == 3) && size >= 12) {
+      prefix = 12;
+      dict_size = read_le32(buffer + 8);
+    } else {
+      return false;
+    }
+    if (prefix + dict_size > size)
+      return false;
+    std::string dict(buffer + prefix, dict_size);
+    header.data_offset = prefix + dict_size;
+
+    // 'descr': '<f8'
+    size_t pos = dict.find("'descr'");
+    if (pos == std::string::npos)
+      return false;
+    size_t begin = dict.find('\'', pos + 7);
+    if (begin == std::string::npos)
+      return false;
+    size_t end = dict.find('\'', begin + 1);
+    if (end == std::string::npos)
+      return false;
+    header.descr = dict.substr(begin + 1, end - begin - 1);
+
+    // 'fortran_order': True
+    pos = dict.find("'fortran_order'");
+    if (pos == std::string::npos)
+      return false;
+    pos = dict.find_first_not_of(": ", pos + 15);
+    if (pos == std::string::npos)
+      return false;
+    header.fortran_order = dict.compare(pos, 4, "True") == 0;
+
+    // 'shape': (3, 4)
+    pos = dict.find("'shape'");
+    if (pos == std::string::npos)
+      return false;
+    begin = dict.find('(', pos);
+    if (begin == std::string::npos)
+      return false;
+    end = dict.find(')', begin);
+    if (end == std::string::npos)
+      return false;
+    header.shape.clear();
+    const char *p = dict.c_str() + begin + 1;
+    const char *stop = dict.c_str() + end;
+    while (p < stop) {
+      char *next;
+      unsigned long long dim = strtoull(p, &next, 10);
+      if (next == p)
+        break;
+      header.shape.push_back(dim);
+      p = next;
+      while (p < stop && (*p == ',' || *p == ' '))
+        ++p;
+    }
+    return true;
+  }
+
+  // Header for a little endian double array of the given shape.
+  inline std::string npy_header(const std::vector<size_t> &shape) {
+    std::string dict = "{'descr': '<f8', 'fortran_order': True, 'shape': (";
+    for (size_t i = 0; i < shape.size(); ++i)
+      dict += std::to_string(shape[i]) + (i + 1 < shape.size() ? ", " : "");
+    if (shape.size() == 1)
+      dict += ",";
+    dict += "), }";
+    size_t unpadded = 10 + dict.size() + 1;
+    dict.append((64 - unpadded % 64) % 64, ' ');
+    dict += '\n';
+    std::string header("\x93" "NUMPY\x01\x00", 8);
+    write_le16(header, dict.size());
+    return header + dict;
+  }
+
+  template <typename T>
+  inline void npy_convert(const char *src, size_t n, bool swap, double *dst) {
+    char bytes[sizeof(T)];
+    for (size_t i = 0; i < n; ++i) {
+      memcpy(bytes, src + i * sizeof(T), sizeof(T));
+      if (swap)
+        std::reverse(bytes, bytes + sizeof(T));
+      T value;
+      memcpy(&value, bytes, sizeof(T));
+      dst[i] = value;
+    }
+  }
+
+  // Converts n elements of the NumPy type 'descr' to doubles.
+  inline bool npy_to_double(const char *src, const std::string &descr,
+                            size_t n, double *dst) {
+    if (descr.size() < 3)
+      return false;
+    bool swap = descr[0] == '>';
+    std::string type = descr.substr(1);
+    if (type == "f8" && !swap) {
+      memcpy(dst, src, sizeof(double) * n);
+    } else if (type == "f8") {
+      npy_convert<double>(src, n, swap, dst);
+    } else if (type == "f4") {
+      npy_convert<float>(src, n, swap, dst);
+    } else if (type == "i8") {
+      npy_convert<int64_t>(src, n, swap, dst);
+    } else if (type == "i4") {
+      npy_convert<int32_t>(src, n, swap, dst);
+    } else if (type == "i2") {
+      npy_convert<int16_t>(src, n, swap, dst);
+    } else if (type == "i1") {
+      npy_convert<int8_t>(src, n, swap, dst);
+    } else if (type == "u8") {
+      npy_convert<uint64_t>(src, n, swap, dst);
+    } else if (type == "u4") {
+      npy_convert<uint32_t>(src, n, swap, dst);
+    } else if (type == "u2") {
+      npy_convert<uint16_t>(src, n, swap, dst);
+    } else if (type == "u1" || type == "b1") {
+      npy_convert<uint8_t>(src, n, swap, dst);
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  // Reads an in-memory npy array. 1-D arrays become single column matrices.
+  inline bool npy_read(const char *buffer, size_t size, Matrix &result) {
+    NpyHeader header;
+    if (!npy_parse_header(buffer, size, header) || header.shape.size() > 2)
+      return false;
+    size_t item_size = atoi(header.descr.c_str() + 2);
+    if (header.data_offset + item_size * header.length() > size)
+      return false;
+    size_t nrows = header.shape.empty() ? 1 : header.shape[0];
+    size_t ncols = header.shape.size() < 2 ? 1 : header.shape[1];
+    const char *src = buffer + header.data_offset;
+    if (header.fortran_order || nrows == 1 || ncols == 1) {
+      result.reshape(nrows, ncols);
+      return npy_to_double(src, header.descr, result.size(), result.data());
+    }
+    // C order: the data is the column major storage of the transpose.
+    Matrix transposed(ncols, nrows);
+    if (!npy_to_double(src, header.descr, transposed.size(),
+                       transposed.data()))
+      return false;
+    result = transpose(transposed);
+    return true;
+  }
+
+  // Reads an in-memory npy array with at most one dimension larger than 1.
+  inline bool npy_read(const char *buffer, size_t size, Vector &result) {
+    NpyHeader header;
+    if (!npy_parse_header(buffer, size, header))
+      return false;
+    size_t length = header.length();
+    for (size_t d : header.shape)
+      if (d != 1 && d != length)
+        return false;
+    size_t item_size = atoi(header.descr.c_str() + 2);
+    if (header.data_offset + item_size * length > size)
+      return false;
+    result.resize(length);
+    return npy_to_double(buffer + header.data_offset, header.descr, length,
+                         result.data());
+  }
+
+  inline bool npy_write(const std::string &filename,
+                        const std::vector<size_t> &shape, const double *data,
+                        size_t length) {
+    std::ofstream ofs(filename, std::ios::binary | std::ios::out);
+    if (!ofs.is_open())
+      return false;
+    std::string header = npy_header(shape);
+    ofs.write(header.data(), header.size());
+    ofs.write(reinterpret_cast<const char*>(data), sizeof(double) * length);
+    return ofs.good();
+  }
+
+  // Saves x as a 1-D float64 array, readable by np.load.
+  inline bool saveNpy(const std::string &filename, const Vector &x) {
+    return npy_write(filename, {x.size()}, x.data(), x.size());
+  }
+
+  // Saves m as a 2-D Fortran ordered float64 array, readable by np.load.
+  inline bool saveNpy(const std::string &filename, const Matrix &m) {
+    return npy_write(filename, {m.nrows(), m.ncols()}, m.data(), m.size());
+  }
+
+  // Loads a 0, 1 or 2 dimensional npy file of any integer or floating
+  // point type. C ordered matrices are transposed into column major order.
+  inline Matrix loadNpy(const std::string &filename) {
+    Matrix result;
+    MemoryMap file(filename);
+    if (file.is_open()) {
+      ASSERT_TRUE(npy_read(file.data(), file.size(), result),
+                  "loadNpy:: Unsupported or corrupted npy file.");
+    }
+    return result;
+  }
+
+  // Loads a npy file holding a vector: a 0 or 1-D array, or a 2-D array
+  // with a single row or column.
+  inline Vector loadNpyVector(const std::string &filename) {
+    Vector result;
+    MemoryMap file(filename);
+    if (file.is_open()) {
+      ASSERT_TRUE(npy_read(file.data(), file.size(), result),
+                  "loadNpyVector:: Unsupported or corrupted npy file.");
+    }
+    return result;
+  }
+
+  // Maps a float64 npy file into memory without copying. The file can be
+  // shared with np.load(filename, mmap_mode='r'). Only Fortran ordered or
+  // 1-D arrays can be mapped, as they match pml's column major layout.
+  inline MatrixView mapNpy(const std::string &filename) {
+    std::shared_ptr<MemoryMap> file = std::make_shared<MemoryMap>(filename);
+    if (!file->is_open())
+      return MatrixView();
+    NpyHeader header;
+    ASSERT_TRUE(npy_parse_header(file->data(), file->size(), header),
+                "mapNpy:: Corrupted npy file.");
+    ASSERT_TRUE(header.descr == "<f8" || header.descr == "=f8",
+                "mapNpy:: Only float64 arrays can be mapped.");
+    ASSERT_TRUE(header.shape.size() <= 2,
+                "mapNpy:: Only 1-D and 2-D arrays can be mapped.");
+    size_t nrows = header.shape.empty() ? 1 : header.shape[0];
+    size_t ncols = header.shape.size() < 2 ? 1 : header.shape[1];
+    ASSERT_TRUE(header.fortran_order || nrows == 1 || ncols == 1,
+                "mapNpy:: C ordered matrices cannot be mapped.");
+    ASSERT_TRUE(header.data_offset % sizeof(double) == 0 &&
+                header.data_offset + sizeof(double) * nrows * ncols <=
+                file->size(), "mapNpy:: Corrupted npy file.");
+    const double *data =
+        reinterpret_cast<const double*>(file->data() + header.data_offset);
+    return MatrixView(nrows, ncols, data, file);
+  }
+
+  // ------- NumPy .npz archives -------
+  //
+  // An .npz file is a zip archive of .npy files, one per array, either
+  // stored (np.savez) or deflated (np.savez_compressed).
+
+  // Saves the arrays in an npz archive. np.load(filename)[name] returns
+  // arrays[name]. Each array must be smaller than 4GB.
+  inline bool saveNpz(const std::string &filename,
+                      const std::map<std::string, Matrix> &arrays,
+                      bool compress = false) {
+    std::ofstream ofs(filename, std::ios::binary | std::ios::out);
+    if (!ofs.is_open())
+      return false;
+    std::string central;
+    uint32_t offset = 0;
+    for (auto &item : arrays) {
+      const Matrix &m = item.second;
+      std::string name = item.first + ".npy";
+      std::string npy = npy_header({m.nrows(), m.ncols()});
+      npy.append(reinterpret_cast<const char*>(m.data()),
+                 sizeof(double) * m.size());
+      ASSERT_TRUE(npy.size() < 0xffffffffUL,
+                  "saveNpz:: Arrays must be smaller than 4GB.");
+      uint32_t crc = crc32(0, reinterpret_cast<const Bytef*>(npy.data()),
+                           npy.size());
+      std::string data;
+      uint16_t method = 0;
+      if (compress) {
+        method = 8;
+        z_stream strm;
+        memset(&strm, 0, sizeof(strm));
+        deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY);
+        data.resize(deflateBound(&strm, npy.size()));
+        strm.next_in = reinterpret_cast<Bytef*>(&npy[0]);
+        strm.avail_in = npy.size();
+        strm.next_out = reinterpret_cast<Bytef*>(&data[0]);
+        strm.avail_out = data.size();
+        deflate(&strm, Z_FINISH);
+        data.resize(strm.total_out);
+        deflateEnd(&strm);
+      } else {
+        data.swap(npy);
+      }
+      size_t uncompressed_size = compress ? npy.size() : data.size();
+
+      // Fields shared by the local and central headers.
+      std::string fields;
+      write_le16(fields, 20);        // version needed to extract
+      write_le16(fields, 0);         // flags
+      write_le16(fields, method);
+      write_le16(fields, 0);         // modification time
+      write_le16(fields, 0x21);      // modification date (1980-01-01)
+      write_le32(fields, crc);
+      write_le32(fields, data.size());
+      write_le32(fields, uncompressed_size);
+      write_le16(fields, name.size());
+      write_le16(fields, 0);         // extra field length
+
+      std::string local;
+      write_le32(local, 0x04034b50);
+      local += fields + name;
+      ofs.write(local.data(), local.size());
+      ofs.write(data.data(), data.size());
+
+      write_le32(central, 0x02014b50);
+      write_le16(central, 20);       // version made by
+      central += fields;
+      write_le16(central, 0);        // comment length
+      write_le16(central, 0);        // disk number
+      write_le16(central, 0);        // internal attributes
+      write_le32(central, 0);        // external attributes
+      write_le32(central, offset);
+      central += name;
+      ASSERT_TRUE(uint64_t(offset) + local.size() + data.size() <
+                  0xffffffffUL, "saveNpz:: Archive must be smaller than 4GB.");
+      offset += local.size() + data.size();
+    }
+    std::string end;
+    write_le32(end, 0x06054b50);
+    write_le16(end, 0);              // disk number
+    write_le16(end, 0);              // disk with the central directory
+    write_le16(end, arrays.size());
+    write_le16(end, arrays.size());
+    write_le32(end, central.size());
+    write_le32(end, offset);
+    write_le16(end, 0);              // comment length
+    ofs.write(central.data(), central.size());
+    ofs.write(end.data(), end.size());
+    return ofs.good();
+  }
+
+  // Loads all arrays of an npz archive (written by np.savez,
+  // np.savez_compressed or saveNpz), keyed by their names.
+  inline std::map<std::string, Matrix> loadNpz(const std::string &filename) {
+    std::map<std::string, Matrix> arrays;
+    MemoryMap file(filename);
+    if (!file.is_open())
+      return arrays;
+    const char *zip = file.data();
+    size_t size = file.size();
+
+    // Find the end of central directory record.
+    ASSERT_TRUE(size >= 22, "loadNpz:: Corrupted npz file.");
+    size_t eocd = size - 22;
+    while (eocd > 0 && read_le32(zip + eocd) != 0x06054b50)
+      --eocd;
+    ASSERT_TRUE(read_le32(zip + eocd) == 0x06054b50,
+                "loadNpz:: Corrupted npz file.");
+    uint64_t num_entries = read_le16(zip + eocd + 10);
+    uint64_t central = read_le32(zip + eocd + 16);
+    // Zip64 archives store the directory location in a separate record.
+    if (eocd >= 20 && read_le32(zip + eocd - 20) == 0x07064b50) {
+      uint64_t offset = read_le64(zip + eocd - 20 + 8);
+      ASSERT_TRUE(offset <= eocd - 20 && eocd - 20 - offset >= 56 &&
+                  read_le32(zip + offset) == 0x06064b50,
+                  "loadNpz:: Corrupted npz file.");
+      const char *eocd64 = zip + offset;
+      num_entries = read_le64(eocd64 + 32);
+      central = read_le64(eocd64 + 48);
+    }
+
+    ASSERT_TRUE(central <= size, "loadNpz:: Corrupted npz file.");
+    const char *p = zip + central;
+    for (uint64_t i = 0; i < num_entries; ++i) {
+      ASSERT_TRUE(p + 46 <= zip + size && read_le32(p) == 0x02014b50,
+                  "loadNpz:: Corrupted npz file.");
+      uint16_t method = read_le16(p + 10);
+      uint64_t compressed_size = read_le32(p + 20);
+      uint64_t uncompressed_size = read_le32(p + 24);
+      uint16_t name_size = read_le16(p + 28);
+      uint16_t extra_size = read_le16(p + 30);
+      uint16_t comment_size = read_le16(p + 32);
+      uint64_t offset = read_le32(p + 42);
+      std::string name(p + 46, name_size);
+      // Zip64 extended sizes and offset.
+      const char *extra = p + 46 + name_size;
+      for (const char *e = extra; e + 4 <= extra + extra_size;
+           e += 4 + read_le16(e + 2)) {
+        if (read_le16(e) != 0x0001)
+          continue;
+        const char *value = e + 4;
+        if (uncompressed_size == 0xffffffffUL) {
+          uncompressed_size = read_le64(value);
+          value += 8;
+        }
+        if (compressed_size == 0xffffffffUL) {
+          compressed_size = read_le64(value);
+          value += 8;
+        }
+        if (offset == 0xffffffffUL)
+          offset = read_le64(value);
+      }
+      p += 46 + name_size + extra_size + comment_size;
+
+      ASSERT_TRUE(offset <= size && size - offset >= 30,
+                  "loadNpz:: Corrupted npz file.");
+      const char *local = zip + offset;
+      ASSERT_TRUE(read_le32(local) == 0x04034b50,
+                  "loadNpz:: Corrupted npz file.");
+      const char *data = local + 30 + read_le16(local + 26) +
+                         read_le16(local + 28);
+      ASSERT_TRUE(data + compressed_size <= zip + size,
+                  "loadNpz:: Corrupted npz file.");
+
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".npy") == 0)
+        name.resize(name.size() - 4);
+      Matrix &m = arrays[name];
+      if (method == 0) {
+        ASSERT_TRUE(npy_read(data, compressed_size, m),
+                    "loadNpz:: Unsupported array " + name);
+      } else {
+        ASSERT_TRUE(method == 8, "loadNpz:: Unsupported compression.");
+        std::vector<char> npy(uncompressed_size);
+        z_stream strm;
+        memset(&strm, 0, sizeof(strm));
+        inflateInit2(&strm, -MAX_WBITS);
+        strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        strm.avail_in = compressed_size;
+        strm.next_out = reinterpret_cast<Bytef*>(npy.data());
+        strm.avail_out = npy.size();
+        int status = inflate(&strm, Z_FINISH);
+        inflateEnd(&strm);
+        ASSERT_TRUE(status == Z_STREAM_END &&
+                    npy_read(npy.data(), npy.size(), m),
+                    "loadNpz:: Unsupported array " + name);
+      }
+    }
+    return arrays;
+  }
+
+} // namespace pml
+
+#endif // PML_NUMPY_H_
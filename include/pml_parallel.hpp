@@ -0,0 +1,59 @@
+#ifndef PML_PARALLEL_H_
+#define PML_PARALLEL_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace pml {
+
+  // Number of threads used by the parallel routines of the library.
+  // Defaults to the number of hardware threads.
+  inline size_t &num_threads_() {
+    static size_t num_threads =
+        std::max<size_t>(1, std::thread::hardware_concurrency());
+    return num_threads;
+  }
+
+  inline size_t get_num_threads() {
+    return num_threads_();
+  }
+
+  inline void set_num_threads(size_t num_threads) {
+    num_threads_() = std::max<size_t>(1, num_threads);
+  }
+
+  // Splits [0, n) into at most get_num_threads() contiguous chunks of at
+  // least 'grain' elements and calls func(start, stop) on each of them in
+  // parallel. Small ranges run on the calling thread.
+  // The chunking depends on the thread count, so func must not rely on it
+  // for its results.
+  template <typename Func>
+  inline void parallel_for(size_t n, size_t grain, Func func) {
+    if (n == 0)
+      return;
+    grain = std::max<size_t>(1, grain);
+    size_t num_chunks = std::min(get_num_threads(), (n + grain - 1) / grain);
+    if (num_chunks <= 1) {
+      func(size_t(0), n);
+      return;
+    }
+    std::vector<std::thread> threads;
+    size_t chunk = n / num_chunks, extra = n % num_chunks, start = 0;
+    for (size_t i = 0; i < num_chunks; ++i) {
+      size_t stop = start + chunk + (i < extra);
+      if (i + 1 == num_chunks) {
+        func(start, stop);
+      } else {
+        threads.emplace_back(func, start, stop);
+      }
+      start = stop;
+    }
+    for (auto &t : threads)
+      t.join();
+  }
+
+} // namespace pml
+
+#endif // PML_PARALLEL_H_
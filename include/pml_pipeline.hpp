@@ -0,0 +1,270 @@
+#ifndef PML_PIPELINE_H_
+#define PML_PIPELINE_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pml {
+
+  // A thread-safe FIFO queue with a maximum capacity. push() blocks while
+  // the queue is full, pop() blocks while it is empty.
+  template <typename T>
+  class BoundedQueue {
+    public:
+      explicit BoundedQueue(size_t capacity_)
+          : capacity(std::max<size_t>(1, capacity_)), closed(false) {}
+
+      // Blocks until there is room. Returns false if the queue is closed.
+      bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this]{ return closed || items.size() < capacity; });
+        if (closed)
+          return false;
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+      }
+
+      // Blocks until an item is available. Returns false if the queue is
+      // closed and drained.
+      bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this]{ return closed || !items.empty(); });
+        if (items.empty())
+          return false;
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+      }
+
+      // Wakes up all waiting threads. Remaining items can still be popped.
+      void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+      }
+
+      size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+      }
+
+    private:
+      size_t capacity;
+      bool closed;
+      std::deque<T> items;
+      std::mutex mutex;
+      std::condition_variable not_empty, not_full;
+  };
+
+  // Loads a list of files on background threads while the caller processes
+  // the previous ones. At most 'capacity' files are loaded ahead of the
+  // caller, and they are returned in the order of the list.
+  //
+  //   Prefetcher<Matrix> prefetcher(files);
+  //   Matrix m;
+  //   while (prefetcher.next(m)) { ... }
+  template <typename T>
+  class Prefetcher {
+    public:
+      typedef std::function<T(const std::string&)> Loader;
+
+      Prefetcher(const std::vector<std::string> &files_,
+                 Loader loader_ = [](const std::string &f){ return T::load(f); },
+                 size_t capacity_ = 4, size_t num_workers = 2)
+          : files(files_), loader(loader_),
+            capacity(std::max<size_t>(1, capacity_)),
+            next_to_load(0), next_to_return(0), stopped(false) {
+        num_workers = std::max<size_t>(1, std::min(num_workers, capacity));
+        for (size_t i = 0; i < num_workers; ++i)
+          workers.emplace_back(&Prefetcher::work, this);
+      }
+
+      Prefetcher(const Prefetcher &) = delete;
+      Prefetcher& operator=(const Prefetcher &) = delete;
+
+      ~Prefetcher() {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          stopped = true;
+        }
+        can_load.notify_all();
+        for (auto &worker : workers)
+          worker.join();
+      }
+
+      // Waits for the next file and moves it into item.
+      // Returns false when all files have been returned. If the loader
+      // threw for this file, the exception is rethrown here and the next
+      // call moves on to the following file.
+      bool next(T &item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (next_to_return == files.size())
+          return false;
+        loaded.wait(lock, [this]{
+          return ready.count(next_to_return) > 0 ||
+                 errors.count(next_to_return) > 0;
+        });
+        ++next_to_return;
+        can_load.notify_all();
+        auto error = errors.find(next_to_return - 1);
+        if (error != errors.end()) {
+          std::exception_ptr e = error->second;
+          errors.erase(error);
+          std::rethrow_exception(e);
+        }
+        auto it = ready.find(next_to_return - 1);
+        item = std::move(it->second);
+        ready.erase(it);
+        return true;
+      }
+
+      // Name of the file returned by the last call to next().
+      const std::string& filename() const {
+        return files[next_to_return - 1];
+      }
+
+    private:
+      void work() {
+        while (true) {
+          size_t index;
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            can_load.wait(lock, [this]{
+              return stopped || next_to_load == files.size() ||
+                     next_to_load < next_to_return + capacity;
+            });
+            if (stopped || next_to_load == files.size())
+              return;
+            index = next_to_load++;
+          }
+          // Loader errors are handed to the caller of next().
+          try {
+            T item = loader(files[index]);
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.emplace(index, std::move(item));
+          } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            errors.emplace(index, std::current_exception());
+          }
+          loaded.notify_one();
+        }
+      }
+
+    private:
+      std::vector<std::string> files;
+      Loader loader;
+      size_t capacity;
+      size_t next_to_load;
+      size_t next_to_return;
+      bool stopped;
+      std::map<size_t, T> ready;
+      std::map<size_t, std::exception_ptr> errors;
+      std::mutex mutex;
+      std::condition_variable can_load, loaded;
+      std::vector<std::thread> workers;
+  };
+
+  // Writes items to files on background threads. write() returns
+  // immediately unless 'capacity' writes are already pending, in which case
+  // it blocks until one of them completes. The first exception thrown by
+  // the writer is rethrown by the next call to write() or flush().
+  //
+  //   AsyncWriter<Matrix> writer;
+  //   writer.write("result.pml", m);
+  template <typename T>
+  class AsyncWriter {
+    public:
+      typedef std::function<void(const std::string&, const T&)> Writer;
+
+      AsyncWriter(Writer writer_ =
+                      [](const std::string &f, const T &x){
+                        if (!x.save(f))
+                          throw std::runtime_error("Cannot write " + f + ".");
+                      },
+                  size_t capacity = 4, size_t num_workers = 1)
+          : writer(writer_), queue(capacity), pending(0) {
+        num_workers = std::max<size_t>(1, num_workers);
+        for (size_t i = 0; i < num_workers; ++i)
+          workers.emplace_back(&AsyncWriter::work, this);
+      }
+
+      AsyncWriter(const AsyncWriter &) = delete;
+      AsyncWriter& operator=(const AsyncWriter &) = delete;
+
+      // Writes the remaining items and stops the workers.
+      ~AsyncWriter() {
+        queue.close();
+        for (auto &worker : workers)
+          worker.join();
+      }
+
+      void write(const std::string &filename, T item) {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          rethrow();
+          ++pending;
+        }
+        queue.push(Job(filename, std::move(item)));
+      }
+
+      // Blocks until all queued items are written.
+      void flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]{ return pending == 0; });
+        rethrow();
+      }
+
+    private:
+      typedef std::pair<std::string, T> Job;
+
+      void work() {
+        Job job;
+        while (queue.pop(job)) {
+          std::exception_ptr e;
+          try {
+            writer(job.first, job.second);
+          } catch (...) {
+            e = std::current_exception();
+          }
+          std::lock_guard<std::mutex> lock(mutex);
+          if (e && !error)
+            error = e;
+          if (--pending == 0)
+            done.notify_all();
+        }
+      }
+
+      // Called with the mutex held.
+      void rethrow() {
+        if (error) {
+          std::exception_ptr e = error;
+          error = nullptr;
+          std::rethrow_exception(e);
+        }
+      }
+
+    private:
+      Writer writer;
+      BoundedQueue<Job> queue;
+      size_t pending;
+      std::exception_ptr error;
+      std::mutex mutex;
+      std::condition_variable done;
+      std::vector<std::thread> workers;
+  };
+
+} // namespace pml
+
+#endif // PML_PIPELINE_H_
@@ -0,0 +1,305 @@
+#ifndef PML_QMC_H_
+#define PML_QMC_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "pml_matrix.hpp"
+#include "pml_parallel.hpp"
+#include "pml_random.hpp"
+
+namespace pml {
+
+  // ------- Quasi-random sequences -------
+  //
+  // Low discrepancy sequences fill the unit cube more evenly than random
+  // points, so Monte Carlo integrals converge at close to O(1/n) instead
+  // of O(1/sqrt(n)). Points are returned as the columns of a dim x n
+  // Matrix, like the samples of a DistributionND, and can be mapped to
+  // other marginals with e.g. Gaussian::quantile.
+  //
+  // Any point can be computed from its index, so seek() is O(1) and
+  // points() fills large blocks in parallel. The first point of an
+  // unscrambled sequence is the origin; skip(1) before mapping to an
+  // unbounded distribution.
+
+  // Sobol sequence in base 2, in Gray code order, with the direction
+  // numbers of Joe and Kuo (new-joe-kuo-6.21201) for the first MAX_DIM
+  // dimensions. The scrambled version applies a random linear matrix
+  // scramble and a digital shift to every dimension.
+  class Sobol {
+    public:
+      explicit Sobol(size_t dim_) : num_dims(dim_), index_(0) {
+        init();
+      }
+
+      Sobol(size_t dim_, Generator &gen) : num_dims(dim_), index_(0) {
+        init();
+        for(size_t d = 0; d < num_dims; ++d){
+          uint32_t *v = &directions[d * BITS];
+          // Lower triangular rows with a unit diagonal, digit 0 first.
+          uint32_t rows[BITS];
+          for(size_t j = 0; j < BITS; ++j){
+            uint32_t diagonal = uint32_t(1) << (BITS - 1 - j);
+            rows[j] = (uint32_t(gen.next()) & ~(diagonal - 1) & ~diagonal)
+                      | diagonal;
+          }
+          for(size_t k = 0; k < BITS; ++k){
+            uint32_t scrambled = 0;
+            for(size_t j = 0; j < BITS; ++j)
+              scrambled |= uint32_t(__builtin_parity(rows[j] & v[k]))
+                           << (BITS - 1 - j);
+            v[k] = scrambled;
+          }
+          shift[d] = uint32_t(gen.next());
+        }
+      }
+
+      size_t dim() const {
+        return num_dims;
+      }
+
+      // Index of the next point.
+      uint64_t index() const {
+        return index_;
+      }
+
+      void seek(uint64_t index) {
+        ASSERT_TRUE(index <= MAX_POINTS, "Sobol::seek:: Index out of range.");
+        index_ = index;
+      }
+
+      void skip(uint64_t n) {
+        seek(index_ + n);
+      }
+
+      // Points index(), ..., index() + n - 1 as columns.
+      Matrix next(size_t n) {
+        Matrix result(num_dims, n);
+        points(index_, n, result.data());
+        index_ += n;
+        return result;
+      }
+
+      // Writes points first, ..., first + n - 1 to out, column by column.
+      void points(uint64_t first, size_t n, double *out) const {
+        ASSERT_TRUE(first + n <= MAX_POINTS,
+                    "Sobol::points:: Index out of range.");
+        size_t num_blocks = (n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        parallel_for(num_blocks, 1, [&](size_t start, size_t stop){
+          std::vector<uint32_t> x(num_dims);
+          for(size_t b = start; b < stop; ++b){
+            uint64_t i = first + b * BLOCK_SIZE;
+            uint64_t end = first + std::min((b + 1) * BLOCK_SIZE, n);
+            // Jump to point i, then step along the Gray code.
+            uint64_t gray = i ^ (i >> 1);
+            for(size_t d = 0; d < num_dims; ++d){
+              x[d] = shift[d];
+              for(size_t k = 0; gray >> k; ++k)
+                if((gray >> k) & 1)
+                  x[d] ^= directions[d * BITS + k];
+            }
+            double *column = out + (i - first) * num_dims;
+            for(; i < end; ++i, column += num_dims){
+              for(size_t d = 0; d < num_dims; ++d)
+                column[d] = x[d] * SCALE;
+              size_t k = __builtin_ctzll(~i);
+              if(k < BITS)
+                for(size_t d = 0; d < num_dims; ++d)
+                  x[d] ^= directions[d * BITS + k];
+            }
+          }
+        });
+      }
+
+    private:
+      void init() {
+        ASSERT_TRUE(num_dims >= 1 && num_dims <= MAX_DIM,
+                    "Sobol::Sobol:: Dimension out of range.");
+        // Degree, polynomial coefficients and initial direction numbers
+        // of dimensions 2, 3, ...
+        static const unsigned table[][10] = {
+          {1,  0, 1},
+          {2,  1, 1, 3},
+          {3,  1, 1, 3, 1},
+          {3,  2, 1, 1, 1},
+          {4,  1, 1, 1, 3, 3},
+          {4,  4, 1, 3, 5, 13},
+          {5,  2, 1, 1, 5, 5, 17},
+          {5,  4, 1, 1, 5, 5, 5},
+          {5,  7, 1, 1, 7, 11, 19},
+          {5, 11, 1, 1, 5, 1, 1},
+          {5, 13, 1, 1, 1, 3, 11},
+          {5, 14, 1, 3, 5, 5, 31},
+          {6,  1, 1, 3, 3, 9, 7, 49},
+          {6, 13, 1, 1, 1, 15, 21, 21},
+          {6, 16, 1, 3, 1, 13, 27, 49},
+          {6, 19, 1, 1, 1, 15, 7, 5},
+          {6, 22, 1, 3, 1, 15, 13, 25},
+          {6, 25, 1, 1, 5, 5, 19, 61},
+          {7,  1, 1, 3, 7, 11, 23, 15, 103},
+          {7,  4, 1, 3, 7, 13, 13, 15, 69},
+          {7,  7, 1, 1, 3, 13, 7, 35, 63},
+          {7,  8, 1, 3, 5, 9, 1, 25, 53},
+          {7, 14, 1, 3, 1, 13, 9, 35, 107},
+          {7, 19, 1, 3, 1, 5, 27, 61, 31},
+          {7, 21, 1, 1, 5, 11, 19, 41, 61},
+          {7, 28, 1, 3, 5, 3, 3, 13, 69},
+          {7, 31, 1, 1, 7, 13, 1, 19, 1},
+          {7, 32, 1, 3, 7, 5, 13, 19, 59},
+          {7, 37, 1, 1, 3, 9, 25, 29, 41},
+          {7, 41, 1, 3, 5, 13, 23, 1, 55},
+          {7, 42, 1, 3, 7, 3, 13, 59, 17},
+          {7, 50, 1, 3, 1, 3, 5, 53, 69},
+          {7, 55, 1, 1, 5, 5, 23, 33, 13},
+          {7, 56, 1, 1, 7, 7, 1, 61, 123},
+          {7, 59, 1, 1, 7, 9, 13, 61, 49},
+          {7, 62, 1, 3, 3, 5, 3, 55, 33}
+        };
+        directions.resize(num_dims * BITS);
+        shift.assign(num_dims, 0);
+        for(size_t k = 0; k < BITS; ++k)
+          directions[k] = uint32_t(1) << (BITS - 1 - k);
+        for(size_t d = 1; d < num_dims; ++d){
+          unsigned s = table[d-1][0], a = table[d-1][1];
+          uint32_t m[BITS];
+          for(size_t k = 0; k < BITS; ++k){
+            if(k < s){
+              m[k] = table[d-1][k+2];
+            } else {
+              m[k] = m[k-s] ^ (m[k-s] << s);
+              for(unsigned j = 1; j < s; ++j)
+                if((a >> (s - 1 - j)) & 1)
+                  m[k] ^= m[k-j] << j;
+            }
+            directions[d * BITS + k] = m[k] << (BITS - 1 - k);
+          }
+        }
+      }
+
+    public:
+      static const size_t MAX_DIM = 37;
+      static const size_t BITS = 32;
+      static const uint64_t MAX_POINTS = uint64_t(1) << 32;
+      static const size_t BLOCK_SIZE = 1 << 12;
+      static constexpr double SCALE = 1.0 / 4294967296.0;
+
+    private:
+      size_t num_dims;
+      std::vector<uint32_t> directions;   // BITS per dimension
+      std::vector<uint32_t> shift;
+      uint64_t index_;
+  };
+
+  // Halton sequence: dimension d is the radical inverse of the index in
+  // the d-th prime base. The scrambled version applies a random affine
+  // permutation, digit -> (a * digit + b) mod base, to every digit of
+  // every dimension, which removes the correlations between the
+  // dimensions with large bases.
+  class Halton {
+    public:
+      explicit Halton(size_t dim_) : index_(0) {
+        init(dim_);
+      }
+
+      Halton(size_t dim_, Generator &gen) : index_(0) {
+        init(dim_);
+        for(size_t d = 0; d < bases.size(); ++d){
+          for(size_t k = 0; k < digits[d]; ++k){
+            multipliers[d].push_back(1 + gen.uniform_int(bases[d] - 1));
+            shifts[d].push_back(gen.uniform_int(bases[d]));
+          }
+        }
+      }
+
+      size_t dim() const {
+        return bases.size();
+      }
+
+      // Index of the next point.
+      uint64_t index() const {
+        return index_;
+      }
+
+      void seek(uint64_t index) {
+        index_ = index;
+      }
+
+      void skip(uint64_t n) {
+        seek(index_ + n);
+      }
+
+      // Points index(), ..., index() + n - 1 as columns.
+      Matrix next(size_t n) {
+        Matrix result(dim(), n);
+        points(index_, n, result.data());
+        index_ += n;
+        return result;
+      }
+
+      // Writes points first, ..., first + n - 1 to out, column by column.
+      void points(uint64_t first, size_t n, double *out) const {
+        size_t dim_ = dim();
+        parallel_for(n, BLOCK_SIZE, [&](size_t start, size_t stop){
+          for(size_t i = start; i < stop; ++i)
+            for(size_t d = 0; d < dim_; ++d)
+              out[i * dim_ + d] = radical_inverse(d, first + i);
+        });
+      }
+
+      // Base of each dimension.
+      const std::vector<uint64_t>& getBases() const {
+        return bases;
+      }
+
+    private:
+      void init(size_t dim_) {
+        ASSERT_TRUE(dim_ >= 1, "Halton::Halton:: Dimension out of range.");
+        for(uint64_t p = 2; bases.size() < dim_; ++p){
+          bool prime = true;
+          for(uint64_t q : bases){
+            if(q * q > p) break;
+            if(p % q == 0){ prime = false; break; }
+          }
+          if(prime)
+            bases.push_back(p);
+        }
+        // Enough digits for double precision.
+        for(uint64_t b : bases){
+          size_t k = 0;
+          for(double scale = 1; scale > 1e-16; scale /= b)
+            ++k;
+          digits.push_back(k);
+        }
+        multipliers.resize(dim_);
+        shifts.resize(dim_);
+      }
+
+      double radical_inverse(size_t d, uint64_t i) const {
+        uint64_t b = bases[d];
+        double inv_b = 1.0 / b, scale = inv_b, result = 0;
+        if(multipliers[d].empty()){
+          for(; i > 0; i /= b, scale *= inv_b)
+            result += (i % b) * scale;
+          return result;
+        }
+        const uint64_t *a = multipliers[d].data(), *c = shifts[d].data();
+        for(size_t k = 0; k < digits[d]; ++k, i /= b, scale *= inv_b)
+          result += ((a[k] * (i % b) + c[k]) % b) * scale;
+        // Points must stay in [0, 1) after rounding.
+        return std::min(result, 1 - 0.5 * std::numeric_limits<double>::epsilon());
+      }
+
+    public:
+      static const size_t BLOCK_SIZE = 1 << 10;
+
+    private:
+      std::vector<uint64_t> bases;
+      std::vector<size_t> digits;
+      std::vector<std::vector<uint64_t>> multipliers, shifts;
+      uint64_t index_;
+  };
+
+} // namespace pml
+
+#endif // PML_QMC_H_
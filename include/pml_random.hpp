@@ -2,63 +2,790 @@
 #define PML_RAND_H_
 
 #include "pml_matrix.hpp"
+#include "pml_parallel.hpp"
 #include "pml_special.hpp"
 
+#include <atomic>
+#include <cstdint>
 #include <ctime>
+#include <unordered_set>
 
 #include <gsl/gsl_randist.h>
 
 namespace pml {
 
+  // ------- xoshiro256** engine -------
+  //
+  // Exposed as a gsl_rng_type, so that all gsl_ran_* samplers can use it.
+  // jump() advances the state by 2^128 steps, which splits the period into
+  // non-overlapping streams.
+
+  struct Xoshiro256State {
+    uint64_t s[4];
+  };
+
+  inline uint64_t rotl64(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  inline uint64_t splitmix64(uint64_t &x) {
+    uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  inline uint64_t xoshiro256_next(Xoshiro256State &state) {
+    uint64_t *s = state.s;
+    uint64_t result = rotl64(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    return result;
+  }
+
+  inline void xoshiro256_seed(Xoshiro256State &state, uint64_t seed) {
+    for (auto &s : state.s)
+      s = splitmix64(seed);
+  }
+
+  inline void xoshiro256_jump(Xoshiro256State &state) {
+    static const uint64_t JUMP[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                    0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+    uint64_t s[4] = {0, 0, 0, 0};
+    for (uint64_t jump : JUMP) {
+      for (int b = 0; b < 64; ++b) {
+        if (jump & (uint64_t(1) << b))
+          for (int i = 0; i < 4; ++i)
+            s[i] ^= state.s[i];
+        xoshiro256_next(state);
+      }
+    }
+    memcpy(state.s, s, sizeof(s));
+  }
+
+  // GSL uses 32 bit integers; the doubles get 53 random bits.
+  inline const gsl_rng_type *xoshiro256_rng_type() {
+    static const gsl_rng_type type = {
+      "xoshiro256**", 0xffffffffUL, 0, sizeof(Xoshiro256State),
+      [](void *state, unsigned long seed) {
+        xoshiro256_seed(*static_cast<Xoshiro256State*>(state), seed);
+      },
+      [](void *state) -> unsigned long {
+        return xoshiro256_next(*static_cast<Xoshiro256State*>(state)) >> 32;
+      },
+      [](void *state) -> double {
+        return (xoshiro256_next(*static_cast<Xoshiro256State*>(state)) >> 11)
+               * (1.0 / 9007199254740992.0);
+      }
+    };
+    return &type;
+  }
+
+  // ------- Philox4x32-10 engine -------
+  //
+  // A counter based generator (Salmon et al., "Parallel random numbers: as
+  // easy as 1, 2, 3"): the draws are a keyed bijection of their position,
+  // so any (stream, offset) is computed directly. The key is the seed and
+  // the counter is (offset / 2, stream); each counter gives two 64 bit
+  // draws.
+
+  struct PhiloxState {
+    uint64_t key;
+    uint64_t stream;
+    uint64_t offset;       // position of the next draw
+    uint64_t cached;       // counter of 'words', plus one; 0 if none
+    uint64_t words[2];
+  };
+
+  inline void philox4x32_10(const uint32_t counter[4], const uint32_t key[2],
+                            uint32_t out[4]) {
+    uint32_t c[4] = {counter[0], counter[1], counter[2], counter[3]};
+    uint32_t k[2] = {key[0], key[1]};
+    for (int round = 0; round < 10; ++round) {
+      uint64_t p0 = uint64_t(0xD2511F53) * c[0];
+      uint64_t p1 = uint64_t(0xCD9E8D57) * c[2];
+      uint32_t next[4] = {uint32_t(p1 >> 32) ^ c[1] ^ k[0], uint32_t(p1),
+                          uint32_t(p0 >> 32) ^ c[3] ^ k[1], uint32_t(p0)};
+      memcpy(c, next, sizeof(c));
+      k[0] += 0x9E3779B9;
+      k[1] += 0xBB67AE85;
+    }
+    memcpy(out, c, sizeof(c));
+  }
+
+  // The two 64 bit draws of a counter.
+  inline void philox_block(uint64_t key, uint64_t stream, uint64_t block,
+                           uint64_t words[2]) {
+    uint32_t counter[4] = {uint32_t(block), uint32_t(block >> 32),
+                           uint32_t(stream), uint32_t(stream >> 32)};
+    uint32_t k[2] = {uint32_t(key), uint32_t(key >> 32)};
+    uint32_t out[4];
+    philox4x32_10(counter, k, out);
+    words[0] = out[0] | (uint64_t(out[1]) << 32);
+    words[1] = out[2] | (uint64_t(out[3]) << 32);
+  }
+
+  inline uint64_t philox_next(PhiloxState &state) {
+    uint64_t block = state.offset >> 1;
+    if (state.cached != block + 1) {
+      philox_block(state.key, state.stream, block, state.words);
+      state.cached = block + 1;
+    }
+    return state.words[state.offset++ & 1];
+  }
+
+  inline void philox_seed(PhiloxState &state, uint64_t seed,
+                          uint64_t stream = 0, uint64_t offset = 0) {
+    state.key = seed;
+    state.stream = stream;
+    state.offset = offset;
+    state.cached = 0;
+  }
+
+  inline const gsl_rng_type *philox_rng_type() {
+    static const gsl_rng_type type = {
+      "philox4x32-10", 0xffffffffUL, 0, sizeof(PhiloxState),
+      [](void *state, unsigned long seed) {
+        philox_seed(*static_cast<PhiloxState*>(state), seed);
+      },
+      [](void *state) -> unsigned long {
+        return philox_next(*static_cast<PhiloxState*>(state)) >> 32;
+      },
+      [](void *state) -> double {
+        return (philox_next(*static_cast<PhiloxState*>(state)) >> 11)
+               * (1.0 / 9007199254740992.0);
+      }
+    };
+    return &type;
+  }
+
+  // ------- Generator -------
+  //
+  // A random number generator that distributions sample from. Generators
+  // built with the same seed and different stream numbers produce
+  // non-overlapping sequences, so each thread can own one.
+  //
+  // The default engine is xoshiro256**. Generator::philox() builds a
+  // counter based generator instead, which can also seek() to any draw in
+  // O(1), so that parts of a random sequence can be regenerated instead of
+  // stored. Every draw consumes one position, so for samplers that use a
+  // fixed number of draws per sample (uniform, Bernoulli, categorical,
+  // bulk Gaussian) sample i is at a known offset; others are best
+  // regenerated per stream.
+  class Generator {
+    public:
+      explicit Generator(uint64_t seed, uint64_t stream = 0)
+          : rng_(gsl_rng_alloc(xoshiro256_rng_type())) {
+        this->seed(seed, stream);
+      }
+
+      // Counter based generator positioned at draw 'offset' of 'stream'.
+      static Generator philox(uint64_t seed, uint64_t stream = 0,
+                              uint64_t offset = 0) {
+        Generator result(Engine{philox_rng_type()});
+        philox_seed(result.philox_state(), seed, stream, offset);
+        return result;
+      }
+
+      Generator(Generator &&that) noexcept : rng_(that.rng_) {
+        that.rng_ = nullptr;
+      }
+
+      Generator& operator=(Generator &&that) noexcept {
+        std::swap(rng_, that.rng_);
+        return *this;
+      }
+
+      Generator(const Generator &) = delete;
+      Generator& operator=(const Generator &) = delete;
+
+      ~Generator() {
+        if (rng_)
+          gsl_rng_free(rng_);
+      }
+
+      bool is_philox() const {
+        return rng_->type == philox_rng_type();
+      }
+
+      // Restarts the sequence at the given stream. For xoshiro256**, stream
+      // k starts k jumps (k * 2^128 steps) after stream 0.
+      void seed(uint64_t seed, uint64_t stream = 0) {
+        if (is_philox()) {
+          philox_seed(philox_state(), seed, stream);
+          return;
+        }
+        xoshiro256_seed(state(), seed);
+        for (uint64_t i = 0; i < stream; ++i)
+          jump();
+      }
+
+      // xoshiro256**: advances 2^128 steps. Philox: moves to the start of
+      // the next stream.
+      void jump() {
+        if (is_philox()) {
+          PhiloxState &s = philox_state();
+          philox_seed(s, s.key, s.stream + 1);
+          return;
+        }
+        xoshiro256_jump(state());
+      }
+
+      // Philox only: moves to draw 'offset' of the current stream.
+      void seek(uint64_t offset) {
+        ASSERT_TRUE(is_philox(), "Generator::seek:: Needs a Philox generator.");
+        philox_state().offset = offset;
+      }
+
+      // Philox only: position of the next draw in the current stream.
+      uint64_t offset() const {
+        ASSERT_TRUE(is_philox(), "Generator::offset:: Needs a Philox generator.");
+        return static_cast<const PhiloxState*>(rng_->state)->offset;
+      }
+
+      // Returns a generator that continues this sequence, and moves this
+      // generator to the next stream.
+      Generator split() {
+        Generator result(Engine{rng_->type});
+        memcpy(result.rng_->state, rng_->state, rng_->type->size);
+        jump();
+        return result;
+      }
+
+      // Raw 64 bit output, e.g. for seeding other generators.
+      uint64_t next() {
+        return is_philox() ? philox_next(philox_state())
+                           : xoshiro256_next(state());
+      }
+
+      // Uniform in [0, 1).
+      double uniform() {
+        return gsl_rng_uniform(rng_);
+      }
+
+      // Uniform integer in [0, n), by Lemire's multiply and reject method.
+      uint64_t uniform_int(uint64_t n) {
+        unsigned __int128 m = (unsigned __int128) next() * n;
+        if (uint64_t(m) < n) {
+          uint64_t threshold = -n % n;
+          while (uint64_t(m) < threshold)
+            m = (unsigned __int128) next() * n;
+        }
+        return m >> 64;
+      }
+
+      // Writes n uniforms in [0, 1) to out, the same values as n calls to
+      // uniform(). Works on a local copy of the state, without going
+      // through gsl_rng.
+      void uniform(double *out, size_t n) {
+        const double scale = 1.0 / 9007199254740992.0;
+        if (is_philox()) {
+          PhiloxState s = philox_state();
+          size_t i = 0;
+          for (; i < n && (s.offset & 1); ++i)
+            out[i] = (philox_next(s) >> 11) * scale;
+          // Whole counters, without the cache.
+          uint64_t words[2];
+          for (; i + 1 < n; i += 2, s.offset += 2) {
+            philox_block(s.key, s.stream, s.offset >> 1, words);
+            out[i] = (words[0] >> 11) * scale;
+            out[i+1] = (words[1] >> 11) * scale;
+          }
+          for (; i < n; ++i)
+            out[i] = (philox_next(s) >> 11) * scale;
+          philox_state() = s;
+          return;
+        }
+        Xoshiro256State s = state();
+        for (size_t i = 0; i < n; ++i)
+          out[i] = (xoshiro256_next(s) >> 11) * scale;
+        state() = s;
+      }
+
+      gsl_rng *rng() const {
+        return rng_;
+      }
+
+    private:
+      struct Engine {
+        const gsl_rng_type *type;
+      };
+
+      explicit Generator(Engine engine)
+          : rng_(gsl_rng_alloc(engine.type)) {}
+
+      Xoshiro256State &state() {
+        return *static_cast<Xoshiro256State*>(rng_->state);
+      }
+
+      PhiloxState &philox_state() {
+        return *static_cast<PhiloxState*>(rng_->state);
+      }
+
+    private:
+      gsl_rng *rng_;
+  };
+
+  // ------- Default generators -------
+  //
+  // Every thread gets its own generator. They all derive from one master
+  // seed, the current time unless rnd_set_seed() is called: the threads
+  // take streams 0, 1, 2, ... in the order they first draw a number.
+  // A single threaded program is therefore reproducible after
+  // rnd_set_seed(). Parallel code that needs reproducible results should
+  // pass explicit Generators instead.
+
+  struct RandomState {
+    RandomState() : seed(time(0)), next_stream(0), epoch(0) {}
+    std::atomic<uint64_t> seed;
+    std::atomic<uint64_t> next_stream;
+    std::atomic<unsigned> epoch;
+  };
+
+  inline RandomState &rnd_state() {
+    static RandomState state;
+    return state;
+  }
+
+  // Reseeds the default generators. Call it before the threads that
+  // sample start.
+  inline void rnd_set_seed(uint64_t seed) {
+    RandomState &state = rnd_state();
+    state.seed = seed;
+    state.next_stream = 0;
+    ++state.epoch;
+  }
+
+  // The calling thread's default generator.
+  inline Generator &rnd_get_generator() {
+    thread_local Generator generator(0);
+    thread_local unsigned epoch = 0;
+    thread_local bool seeded = false;
+    RandomState &state = rnd_state();
+    unsigned current = state.epoch;
+    if (!seeded || epoch != current) {
+      generator.seed(state.seed, state.next_stream++);
+      epoch = current;
+      seeded = true;
+    }
+    return generator;
+  }
+
+  // The same, for calling gsl functions directly.
   inline gsl_rng *rnd_get_rng() {
-    static gsl_rng *rng = NULL;
-    if (rng == NULL) {
-      gsl_rng_env_setup();
-      rng = gsl_rng_alloc(gsl_rng_default);
-      gsl_rng_set(rng, (unsigned long) time(0));
+    return rnd_get_generator().rng();
+  }
+
+  // ------- Standard samplers -------
+
+  // N(0, 1) samples by the Box-Muller transform on blocks of uniforms.
+  // Each pair of uniforms gives two samples, with no rejections or
+  // branches in the loop.
+  inline void standard_normal(double *out, size_t n, Generator &gen) {
+    const size_t BLOCK = 256;
+    double u[BLOCK];
+    for(size_t start = 0; start < n; start += BLOCK){
+      size_t m = std::min(BLOCK, n - start);
+      size_t pairs = (m + 1) / 2;
+      gen.uniform(u, 2 * pairs);
+      double *x = out + start;
+      for(size_t i = 0; i < m / 2; ++i){
+        double r = std::sqrt(-2 * std::log(1 - u[2*i]));
+        double theta = 2 * M_PI * u[2*i+1];
+        x[2*i] = r * std::cos(theta);
+        x[2*i+1] = r * std::sin(theta);
+      }
+      if(m % 2)
+        x[m-1] = std::sqrt(-2 * std::log(1 - u[m-1])) * std::cos(2 * M_PI * u[m]);
+    }
+  }
+
+  // Gamma(a, 1) samples by Marsaglia and Tsang's method: with d = a - 1/3,
+  // d(1 + x / sqrt(9d))^3 for a normal x is accepted with a squeeze test
+  // that needs no logarithm about 98% of the time. For a < 1, a
+  // Gamma(a + 1) sample is multiplied by u^(1/a).
+  inline double standard_gamma(double a, Generator &gen) {
+    double boost = 1;
+    if(a < 1){
+      boost = std::pow(1 - gen.uniform(), 1 / a);
+      a += 1;
+    }
+    double d = a - 1.0 / 3, c = 1 / std::sqrt(9 * d);
+    while(true){
+      double x = gsl_ran_gaussian_ziggurat(gen.rng(), 1);
+      double v = 1 + c * x;
+      if(v <= 0)
+        continue;
+      v = v * v * v;
+      double u = gen.uniform();
+      if(u < 1 - 0.0331 * x * x * x * x ||
+         std::log(u) < 0.5 * x * x + d * (1 - v + std::log(v)))
+        return d * v * boost;
     }
-    return rng;
+  }
+
+  // Batched version. Each pair of samples owns a fixed run of uniforms:
+  // two Box-Muller pairs give two candidates for each, four uniforms test
+  // them and, for a < 1, two more are the boosts. The first k of n samples
+  // are thus the same as k samples, whatever n is. The second candidates
+  // are only computed when needed, and when both are rejected, well under
+  // 1% of the time, the sample continues on a generator seeded from its
+  // own uniforms.
+  inline void standard_gamma(double a, double *out, size_t n, Generator &gen) {
+    const size_t BLOCK = 128;
+    const size_t STRIDE = a < 1 ? 10 : 8;
+    double u[BLOCK * 10];
+    double shape = a < 1 ? a + 1 : a;
+    double d = shape - 1.0 / 3, c = 1 / std::sqrt(9 * d);
+    auto accept = [&](double x, double u, double &value){
+      double t = 1 + c * x, v = t * t * t, x2 = x * x;
+      value = d * v;
+      return t > 0 && (u < 1 - 0.0331 * x2 * x2 ||
+                       std::log(u) < 0.5 * x2 + d * (1 - v + std::log(v)));
+    };
+    // Two normals from the Box-Muller pair (u1, u2).
+    auto normals = [](double u1, double u2, double *x){
+      double r = std::sqrt(-2 * std::log(1 - u1)), theta = 2 * M_PI * u2;
+      x[0] = r * std::cos(theta);
+      x[1] = r * std::sin(theta);
+    };
+    size_t pairs = (n + 1) / 2;
+    for(size_t start = 0; start < pairs; start += BLOCK){
+      size_t m = std::min(BLOCK, pairs - start);
+      gen.uniform(u, m * STRIDE);
+      for(size_t p = 0; p < m; ++p){
+        const double *w = u + p * STRIDE;
+        double x[4];
+        normals(w[0], w[1], x);
+        bool second = false;
+        for(size_t k = 0; k < 2 && 2 * (start + p) + k < n; ++k){
+          double value;
+          if(!accept(x[k], w[2+k], value)){
+            if(!second){
+              normals(w[4], w[5], x + 2);
+              second = true;
+            }
+            if(!accept(x[2+k], w[6+k], value)){
+              uint64_t seed = k;
+              for(size_t j = 0; j < 8; ++j)
+                seed = seed * 0x9e3779b97f4a7c15ULL +
+                       uint64_t(w[j] * 9007199254740992.0);
+              Generator local(seed);
+              value = standard_gamma(shape, local);
+            }
+          }
+          if(a < 1)
+            value *= std::pow(1 - w[8+k], 1 / a);
+          out[2 * (start + p) + k] = value;
+        }
+      }
+    }
+  }
+
+  // log(n!) for a count n. Counts below LOG_FACTORIAL_TABLE_SIZE are read
+  // from a table shared by the whole process, whose chunks are filled on
+  // first use; larger counts use gammaln. Taking a double keeps huge
+  // counts out of integer conversions.
+  const size_t LOG_FACTORIAL_TABLE_SIZE = 1 << 20;
+
+  inline double log_factorial(double n) {
+    static const SpecialTable table(1, LOG_FACTORIAL_TABLE_SIZE);
+    return n < LOG_FACTORIAL_TABLE_SIZE ? table.gammaln(size_t(n))
+                                        : gammaln(n + 1);
+  }
+
+  // Checks whether x is a count, i.e. a non-negative integer.
+  inline bool is_count(double x) {
+    return x >= 0 && x == std::floor(x);
   }
 
   // Abstract Class for Uni-variate Distributions.
+  // Subclasses implement randgen(gen) for one sample, and may override the
+  // bulk randgen(out, n, gen) with a faster batched algorithm.
   class Distribution1D{
     public:
-      virtual double randgen() const = 0;
+      virtual double randgen(Generator &gen) const = 0;
+
+      // One sample from the global generator. Kept for callers of the old
+      // randgen(); subclasses override randgen(gen).
+      double randgen() const {
+        return randgen(rnd_get_generator());
+      }
+
+      virtual void randgen(double *out, size_t n, Generator &gen) const {
+        for(size_t i = 0; i < n; ++i)
+          out[i] = randgen(gen);
+      }
 
       double rand() const{
-        return randgen();
+        return randgen(rnd_get_generator());
+      };
+
+      double rand(Generator &gen) const{
+        return randgen(gen);
       };
 
       Vector rand(size_t length) const{
+        return rand(length, rnd_get_generator());
+      }
+
+      Vector rand(size_t length, Generator &gen) const{
         Vector result(length);
-        for(auto &d : result)
-          d = rand();
+        fill(result.data(), length, gen);
         return result;
       }
 
       Matrix rand(size_t nrows, size_t ncols) const {
+        return rand(nrows, ncols, rnd_get_generator());
+      }
+
+      // Matrices of a block or more are sampled in parallel, see
+      // fill(out, n, seed).
+      Matrix rand(size_t nrows, size_t ncols, Generator &gen) const {
         Matrix result(nrows, ncols);
-        for(auto &d : result)
-          d = rand();
+        if(result.size() < BLOCK_SIZE)
+          fill(result.data(), result.size(), gen);
+        else
+          fill(result.data(), result.size(), gen.next());
         return result;
       }
+
+      // Writes n samples to out.
+      void fill(double *out, size_t n) const {
+        randgen(out, n, rnd_get_generator());
+      }
+
+      void fill(double *out, size_t n, Generator &gen) const {
+        randgen(out, n, gen);
+      }
+
+      // Writes samples [first, first + n) of the sequence defined by the
+      // seed to out, in parallel. Block b of BLOCK_SIZE samples is drawn
+      // from Philox stream b of the seed, so the result is the same for any
+      // number of threads, and any part of the sequence is regenerated by
+      // sampling only the blocks it overlaps. Blocks are always sampled
+      // whole, since a bulk randgen need not give the same leading values
+      // for a shorter block.
+      void fill(double *out, size_t n, uint64_t seed, size_t first = 0) const {
+        if(n == 0)
+          return;
+        size_t first_block = first / BLOCK_SIZE;
+        size_t num_blocks = (first + n - 1) / BLOCK_SIZE + 1 - first_block;
+        parallel_for(num_blocks, 1, [&](size_t start, size_t stop){
+          std::vector<double> buffer;
+          for(size_t b = first_block + start; b < first_block + stop; ++b){
+            Generator gen = Generator::philox(seed, b);
+            size_t begin = std::max(b * BLOCK_SIZE, first);
+            size_t end = std::min((b + 1) * BLOCK_SIZE, first + n);
+            if(end - begin == BLOCK_SIZE){
+              randgen(out + begin - first, BLOCK_SIZE, gen);
+            } else {
+              // A partial block at either end of the range
+              buffer.resize(BLOCK_SIZE);
+              randgen(buffer.data(), BLOCK_SIZE, gen);
+              std::copy(buffer.begin() + (begin - b * BLOCK_SIZE),
+                        buffer.begin() + (end - b * BLOCK_SIZE),
+                        out + begin - first);
+            }
+          }
+        });
+      }
+
+    public:
+      // Writes log p(x[i]) to out[i] for i < n. Subclasses with a density
+      // override this.
+      virtual void log_pdf(const double *, size_t, double *) const {
+        ASSERT_TRUE(false, "Distribution1D::log_pdf:: Not implemented.");
+      }
+
+      double log_pdf(double x) const {
+        double result;
+        log_pdf(&x, 1, &result);
+        return result;
+      }
+
+      Vector log_pdf(const Vector &x) const {
+        Vector result(x.size());
+        log_pdf_parallel(x.data(), x.size(), result.data());
+        return result;
+      }
+
+      Matrix log_pdf(const Matrix &x) const {
+        Matrix result(x.nrows(), x.ncols());
+        log_pdf_parallel(x.data(), x.size(), result.data());
+        return result;
+      }
+
+      // Sum of log_pdf(x). Partial sums of fixed blocks are added in order,
+      // so the result does not depend on the number of threads.
+      double log_likelihood(const Vector &x) const {
+        return log_likelihood(x.data(), x.size());
+      }
+
+      double log_likelihood(const Matrix &x) const {
+        return log_likelihood(x.data(), x.size());
+      }
+
+    private:
+      void log_pdf_parallel(const double *x, size_t n, double *out) const {
+        parallel_for(n, 1 << 14, [&](size_t start, size_t stop){
+          log_pdf(x + start, stop - start, out + start);
+        });
+      }
+
+      double log_likelihood(const double *x, size_t n) const {
+        const size_t BLOCK = 1 << 12;
+        size_t num_blocks = (n + BLOCK - 1) / BLOCK;
+        std::vector<double> partial(num_blocks);
+        parallel_for(num_blocks, 4, [&](size_t start, size_t stop){
+          double buffer[BLOCK];
+          for(size_t b = start; b < stop; ++b){
+            size_t m = std::min(BLOCK, n - b * BLOCK);
+            log_pdf(x + b * BLOCK, m, buffer);
+            double total = 0;
+            for(size_t i = 0; i < m; ++i)
+              total += buffer[i];
+            partial[b] = total;
+          }
+        });
+        double result = 0;
+        for(double d : partial)
+          result += d;
+        return result;
+      }
+
+    public:
+      static const size_t BLOCK_SIZE = 1 << 16;
   };
 
   // Abstract Class for Multi-variate Distributions.
+  // Subclasses implement randgen(gen) for one sample, and may override the
+  // bulk randgen(out, ncols, gen) with a faster batched algorithm.
   class DistributionND{
     public:
-      virtual Vector randgen() = 0;
+      virtual Vector randgen(Generator &gen) = 0;
+
+      // One sample from the global generator. Kept for callers of the old
+      // randgen(); subclasses override randgen(gen).
+      Vector randgen() {
+        return randgen(rnd_get_generator());
+      }
+
+      // Dimension of the samples, or 0 if the subclass does not say. Such
+      // subclasses are sampled one column at a time by rand(ncols), and
+      // log_pdf does not check the dimension of its input.
+      virtual size_t dim() const {
+        return 0;
+      }
+
+      // Writes ncols samples to the columns of out, a dim() x ncols column
+      // major array.
+      virtual void randgen(double *out, size_t ncols, Generator &gen) {
+        for(size_t j = 0; j < ncols; ++j){
+          Vector x = randgen(gen);
+          memcpy(out + j * x.size(), x.data(), sizeof(double) * x.size());
+        }
+      }
 
       Vector rand() {
-        return randgen();
+        return randgen(rnd_get_generator());
+      }
+
+      Vector rand(Generator &gen) {
+        return randgen(gen);
       }
 
       Matrix rand(size_t ncols) {
-        Matrix result;
-        for(size_t i = 0; i < ncols; ++i)
-          result.appendColumn(rand());
+        return rand(ncols, rnd_get_generator());
+      }
+
+      // A block or more of columns is sampled in parallel, see
+      // fill(out, ncols, seed).
+      Matrix rand(size_t ncols, Generator &gen) {
+        if(dim() == 0){
+          Matrix result;
+          for(size_t j = 0; j < ncols; ++j)
+            result.appendColumn(randgen(gen));
+          return result;
+        }
+        Matrix result(dim(), ncols);
+        if(ncols < BLOCK_SIZE)
+          randgen(result.data(), ncols, gen);
+        else
+          fill(result.data(), ncols, gen.next());
+        return result;
+      }
+
+      // Writes columns [first, first + ncols) of the sequence defined by
+      // the seed to out, in parallel. Block b of BLOCK_SIZE columns is
+      // drawn whole from Philox stream b of the seed, so the result is the
+      // same for any number of threads and any part of the sequence is
+      // regenerated exactly. randgen() must be safe to call concurrently,
+      // and dim() must be known.
+      void fill(double *out, size_t ncols, uint64_t seed, size_t first = 0) {
+        ASSERT_TRUE(dim() > 0, "DistributionND::fill:: Unknown dimension.");
+        if(ncols == 0)
+          return;
+        size_t d = dim();
+        size_t first_block = first / BLOCK_SIZE;
+        size_t num_blocks = (first + ncols - 1) / BLOCK_SIZE + 1 - first_block;
+        parallel_for(num_blocks, 1, [&](size_t start, size_t stop){
+          std::vector<double> buffer;
+          for(size_t b = first_block + start; b < first_block + stop; ++b){
+            Generator gen = Generator::philox(seed, b);
+            size_t begin = std::max(b * BLOCK_SIZE, first);
+            size_t end = std::min((b + 1) * BLOCK_SIZE, first + ncols);
+            if(end - begin == BLOCK_SIZE){
+              randgen(out + (begin - first) * d, BLOCK_SIZE, gen);
+            } else {
+              buffer.resize(BLOCK_SIZE * d);
+              randgen(buffer.data(), BLOCK_SIZE, gen);
+              std::copy(buffer.begin() + (begin - b * BLOCK_SIZE) * d,
+                        buffer.begin() + (end - b * BLOCK_SIZE) * d,
+                        out + (begin - first) * d);
+            }
+          }
+        });
+      }
+
+      // Writes log p(x_j) to out[j] for the columns x_j of X, a dim() x ncols
+      // column major array. Subclasses with a density override this.
+      virtual void log_pdf(const double *, size_t, double *) const {
+        ASSERT_TRUE(false, "DistributionND::log_pdf:: Not implemented.");
+      }
+
+      double log_pdf(const Vector &x) const {
+        ASSERT_TRUE(dim() == 0 || x.size() == dim(),
+                    "log_pdf:: Dimension mismatch.");
+        double result;
+        log_pdf(x.data(), 1, &result);
         return result;
       }
+
+      // log_pdf of each column.
+      Vector log_pdf(const Matrix &X) const {
+        ASSERT_TRUE(dim() == 0 || X.nrows() == dim(),
+                    "log_pdf:: Dimension mismatch.");
+        Vector result(X.ncols());
+        parallel_for(X.ncols(), 256, [&](size_t start, size_t stop){
+          log_pdf(X.data() + start * X.nrows(), stop - start,
+                  result.data() + start);
+        });
+        return result;
+      }
+
+      // Sum of the log_pdf of the columns.
+      double log_likelihood(const Matrix &X) const {
+        return sum(log_pdf(X));
+      }
+
+    public:
+      static const size_t BLOCK_SIZE = 1 << 10;
   };
 
   class Uniform : public Distribution1D {
@@ -67,13 +794,21 @@ namespace pml {
         range = high - low;
       }
 
-      double randgen() const override{
-        return low + gsl_rng_uniform(rnd_get_rng()) * range;
+      using Distribution1D::randgen;
+
+      double randgen(Generator &gen) const override{
+        return low + gsl_rng_uniform(gen.rng()) * range;
+      }
+
+      void randgen(double *out, size_t n, Generator &gen) const override{
+        gen.uniform(out, n);
+        for(size_t i = 0; i < n; ++i)
+          out[i] = low + out[i] * range;
       }
 
       // Integer versions:
       int randi(){
-        return randgen();
+        return rand();
       }
 
       Vector randi(size_t length) {
@@ -84,6 +819,37 @@ namespace pml {
         return ceil(rand(nrows, ncols));
       }
 
+      using Distribution1D::log_pdf;
+
+      void log_pdf(const double *x, size_t n, double *out) const override {
+        const double inf = std::numeric_limits<double>::infinity();
+        double log_density = -std::log(range);
+        for(size_t i = 0; i < n; ++i)
+          out[i] = (x[i] >= low && x[i] < high) ? log_density : -inf;
+      }
+
+      // Inverse of the cdf, e.g. to map quasi-random points to samples.
+      double quantile(double p) const {
+        return low + p * range;
+      }
+
+      void quantile(const double *p, size_t n, double *out) const {
+        for(size_t i = 0; i < n; ++i)
+          out[i] = low + p[i] * range;
+      }
+
+      Vector quantile(const Vector &p) const {
+        Vector result(p.size());
+        quantile(p.data(), p.size(), result.data());
+        return result;
+      }
+
+      Matrix quantile(const Matrix &p) const {
+        Matrix result(p.nrows(), p.ncols());
+        quantile(p.data(), p.size(), result.data());
+        return result;
+      }
+
     private:
       double low, high, range;
   };
@@ -92,23 +858,161 @@ namespace pml {
     public:
       Bernoulli(double p_) : p(p_){}
 
-      double randgen() const override {
-        return gsl_rng_uniform(rnd_get_rng()) < p;
+      using Distribution1D::randgen;
+
+      double randgen(Generator &gen) const override {
+        return gsl_rng_uniform(gen.rng()) < p;
+      }
+
+      void randgen(double *out, size_t n, Generator &gen) const override {
+        gen.uniform(out, n);
+        for(size_t i = 0; i < n; ++i)
+          out[i] = out[i] < p;
+      }
+
+      using Distribution1D::log_pdf;
+
+      void log_pdf(const double *x, size_t n, double *out) const override {
+        const double inf = std::numeric_limits<double>::infinity();
+        double log_p = std::log(p), log_q = std::log1p(-p);
+        for(size_t i = 0; i < n; ++i)
+          out[i] = x[i] == 1 ? log_p : x[i] == 0 ? log_q : -inf;
       }
 
     public:
       double p;
   };
 
+  // Walker's alias method, built with Vose's algorithm. Draws from a
+  // discrete distribution in O(1) with a single uniform: pick a bin
+  // uniformly, then either the bin itself or its alias. Rebuilding reuses
+  // the storage.
+  class AliasTable {
+    public:
+      AliasTable() {}
+
+      AliasTable(const double *weights, size_t K) {
+        build(weights, K);
+      }
+
+      // Weights need not be normalized.
+      void build(const double *weights, size_t K) {
+        ASSERT_TRUE(K > 0, "AliasTable:: Empty weights.");
+        double total = 0;
+        for(size_t i = 0; i < K; ++i)
+          total += weights[i];
+        ASSERT_TRUE(total > 0, "AliasTable:: Weights must have a positive sum.");
+        prob_.resize(K);
+        alias_.resize(K);
+        small_.clear();
+        large_.clear();
+        for(size_t i = 0; i < K; ++i){
+          prob_[i] = weights[i] * K / total;
+          if(prob_[i] < 1)
+            small_.push_back(i);
+          else
+            large_.push_back(i);
+        }
+        while(!small_.empty() && !large_.empty()){
+          unsigned s = small_.back(), l = large_.back();
+          small_.pop_back();
+          alias_[s] = l;
+          prob_[l] -= 1 - prob_[s];
+          if(prob_[l] < 1){
+            large_.pop_back();
+            small_.push_back(l);
+          }
+        }
+        // Only rounding errors are left.
+        for(unsigned i : large_){
+          prob_[i] = 1;
+          alias_[i] = i;
+        }
+        for(unsigned i : small_){
+          prob_[i] = 1;
+          alias_[i] = i;
+        }
+      }
+
+      size_t size() const {
+        return prob_.size();
+      }
+
+      // Maps a uniform in [0, 1) to a sample.
+      unsigned sample(double u) const {
+        double x = u * prob_.size();
+        unsigned i = x;
+        return (x - i) < prob_[i] ? i : alias_[i];
+      }
+
+      unsigned sample(Generator &gen) const {
+        return sample(gen.uniform());
+      }
+
+      void sample(unsigned *out, size_t n, Generator &gen) const {
+        const size_t BLOCK = 256;
+        double u[BLOCK];
+        for(size_t start = 0; start < n; start += BLOCK){
+          size_t m = std::min(BLOCK, n - start);
+          gen.uniform(u, m);
+          for(size_t i = 0; i < m; ++i)
+            out[start + i] = sample(u[i]);
+        }
+      }
+
+    private:
+      std::vector<double> prob_;
+      std::vector<unsigned> alias_;
+      std::vector<unsigned> small_, large_;   // work space for build()
+  };
+
   class Categorical : public Distribution1D{
     public:
       Categorical(const Vector &p_) {
-        p = normalize(p_);
-        ptable = gsl_ran_discrete_preproc (p.size(), p.data());
+        setProbabilities(p_);
       }
 
-      double randgen() const override {
-        return gsl_ran_discrete(rnd_get_rng(), ptable);
+      // Replaces the probabilities. p, log_p and the alias table are
+      // rewritten in place, so rebuilding with the same number of
+      // categories does not allocate. p_ may be p itself.
+      void setProbabilities(const Vector &p_) {
+        double total = sum(p_);
+        p.resize(p_.size());
+        log_p.resize(p_.size());
+        for(size_t i = 0; i < p.size(); ++i){
+          p[i] = p_[i] / total;
+          log_p[i] = std::log(p[i]);
+        }
+        table.build(p.data(), p.size());
+      }
+
+      using Distribution1D::randgen;
+
+      double randgen(Generator &gen) const override {
+        return table.sample(gen);
+      }
+
+      void randgen(double *out, size_t n, Generator &gen) const override {
+        gen.uniform(out, n);
+        for(size_t i = 0; i < n; ++i)
+          out[i] = table.sample(out[i]);
+      }
+
+      // Writes n samples to an integer buffer.
+      void randi(unsigned *out, size_t n) const {
+        table.sample(out, n, rnd_get_generator());
+      }
+
+      void randi(unsigned *out, size_t n, Generator &gen) const {
+        table.sample(out, n, gen);
+      }
+
+      using Distribution1D::log_pdf;
+
+      void log_pdf(const double *x, size_t n, double *out) const override {
+        const double inf = std::numeric_limits<double>::infinity();
+        for(size_t i = 0; i < n; ++i)
+          out[i] = (is_count(x[i]) && x[i] < p.size()) ? log_p[x[i]] : -inf;
       }
 
       static Categorical fit(const Vector &data, size_t K){
@@ -119,28 +1023,64 @@ namespace pml {
 
     public:
       Vector p;
-      gsl_ran_discrete_t *ptable;
+
+    private:
+      AliasTable table;
+      Vector log_p;
   };
 
   class Binomial : public Distribution1D{
     public:
-      Binomial(double pi_, size_t trials_) : pi(pi_), trials(trials_) {}
+      Binomial(double pi_, size_t trials_) : pi(pi_), trials(trials_) {
+        log_pi = std::log(pi);
+        log_q = std::log1p(-pi);
+        log_norm = log_factorial(trials);
+      }
+
+      using Distribution1D::randgen;
 
-      double randgen() const override {
-        return gsl_ran_binomial(rnd_get_rng(), pi, trials);
+      double randgen(Generator &gen) const override {
+        return gsl_ran_binomial(gen.rng(), pi, trials);
       }
 
-      double pmf(unsigned i, unsigned j) {
-        return gsl_ran_binomial_pdf(j, pi, i);
+      // Probability of j successes in i trials.
+      double pmf(unsigned i, unsigned j) const {
+        return std::exp(log_pmf(i, j));
       }
 
-      double log_pmf(unsigned i, unsigned j) {
-        return std::log(pmf(i, j));
+      double log_pmf(unsigned i, unsigned j) const {
+        if(j > i)
+          return -std::numeric_limits<double>::infinity();
+        return gammaln(i + 1.0) - gammaln(j + 1.0) -
+               gammaln(i - j + 1.0) + log_term(j, i - j);
+      }
+
+      using Distribution1D::log_pdf;
+
+      void log_pdf(const double *x, size_t n, double *out) const override {
+        const double inf = std::numeric_limits<double>::infinity();
+        for(size_t i = 0; i < n; ++i){
+          if(is_count(x[i]) && x[i] <= trials)
+            out[i] = log_norm - log_factorial(x[i]) -
+                     log_factorial(trials - x[i]) +
+                     log_term(x[i], trials - x[i]);
+          else
+            out[i] = -inf;
+        }
+      }
+
+    private:
+      // log(pi^k (1-pi)^m), where 0^0 = 1.
+      double log_term(double k, double m) const {
+        return (k > 0 ? k * log_pi : 0) + (m > 0 ? m * log_q : 0);
       }
 
     public:
       double pi;
       size_t trials;
+
+    private:
+      double log_pi, log_q, log_norm;
   };
 
   class Multinomial : public DistributionND{
@@ -148,43 +1088,135 @@ namespace pml {
     public:
       Multinomial(const Vector &p_, size_t trials_){
         p = normalize(p_);
+        log_p = log(p);
         trials = trials_;
       }
 
-      Vector randgen() override {
-        Vector samples(p.size());
-        unsigned buf[p.size()];
-        gsl_ran_multinomial(rnd_get_rng(), p.size(), trials, p.data(), buf);
-        for (size_t i = 0; i < samples.size(); ++i) {
-          samples(i) = buf[i];
+      size_t dim() const override {
+        return p.size();
+      }
+
+      using DistributionND::randgen;
+
+      Vector randgen(Generator &gen) override {
+        Vector sample(p.size());
+        randgen(sample.data(), 1, gen);
+        return sample;
+      }
+
+      // Conditional binomial method: the count of category k is binomial
+      // with probability p_k / (p_k + ... + p_K), given the counts of the
+      // categories before it. The remaining mass is carried along, so no
+      // work space is needed.
+      void randgen(double *out, size_t ncols, Generator &gen) override {
+        size_t K = p.size();
+        for(size_t j = 0; j < ncols; ++j){
+          double *x = out + j * K;
+          unsigned remaining = trials;
+          double rest = 1;
+          for(size_t k = 0; k + 1 < K; ++k){
+            double q = rest > 0 ? std::min(1.0, p[k] / rest) : 1;
+            rest -= p[k];
+            unsigned count = (remaining == 0 || q == 0) ? 0 :
+                             (q == 1) ? remaining :
+                             gsl_ran_binomial(gen.rng(), q, remaining);
+            x[k] = count;
+            remaining -= count;
+          }
+          x[K-1] = remaining;
         }
-        return samples;
       }
-/*
-      double log_pmf(const Vector &x) {
-        unsigned counts[x.size()];
-        for (size_t i = 0; i < x.size(); ++i) {
-          counts[i] = (size_t) x(i);
+
+      // log p(x) = log(N!) - sum_k log(x_k!) + sum_k x_k log(p_k),
+      // -inf if the counts do not sum to N.
+      using DistributionND::log_pdf;
+
+      void log_pdf(const double *X, size_t ncols, double *out) const override {
+        const double inf = std::numeric_limits<double>::infinity();
+        size_t K = p.size();
+        double log_norm = log_factorial(trials);
+        for(size_t j = 0; j < ncols; ++j){
+          const double *x = X + j * K;
+          double result = log_norm;
+          double total = 0;
+          for(size_t k = 0; k < K; ++k){
+            if(!is_count(x[k])){
+              total = -1;
+              break;
+            }
+            total += x[k];
+            if(x[k] > 0)
+              result += x[k] * log_p[k] - log_factorial(x[k]);
+          }
+          out[j] = total == trials ? result : -inf;
         }
-        return gsl_ran_multinomial_lnpdf(p.size(), p.data(), counts);
       }
 
-      double pmf(Vector &x, Vector &p) {
-        return std::exp(log_pmf(x, p));
+      double log_pmf(const Vector &x) const {
+        return log_pdf(x);
       }
-*/
+
+      double pmf(const Vector &x) const {
+        return std::exp(log_pdf(x));
+      }
+
+      Vector log_pmf(const Matrix &X) const {
+        return log_pdf(X);
+      }
+
     public:
       Vector p;
       size_t trials;
-  };
 
+    private:
+      Vector log_p;
+  };
 
   class Gaussian : public Distribution1D{
     public:
       Gaussian(double mu_ = 0, double sigma_ = 1) : mu(mu_), sigma(sigma_) {}
 
-      double randgen() const override {
-        return mu + gsl_ran_gaussian(rnd_get_rng(), sigma);
+      using Distribution1D::randgen;
+
+      double randgen(Generator &gen) const override {
+        return mu + gsl_ran_gaussian(gen.rng(), sigma);
+      }
+
+      void randgen(double *out, size_t n, Generator &gen) const override {
+        standard_normal(out, n, gen);
+        for(size_t i = 0; i < n; ++i)
+          out[i] = mu + sigma * out[i];
+      }
+
+      using Distribution1D::log_pdf;
+
+      void log_pdf(const double *x, size_t n, double *out) const override {
+        double log_norm = -0.5 * std::log(2 * M_PI * sigma * sigma);
+        double scale = -0.5 / (sigma * sigma);
+        for(size_t i = 0; i < n; ++i)
+          out[i] = log_norm + scale * (x[i] - mu) * (x[i] - mu);
+      }
+
+      // Inverse of the cdf, e.g. to map quasi-random points to samples.
+      double quantile(double p) const {
+        return mu + sigma * normal_quantile(p);
+      }
+
+      void quantile(const double *p, size_t n, double *out) const {
+        for(size_t i = 0; i < n; ++i)
+          out[i] = mu + sigma * normal_quantile(p[i]);
+      }
+
+      Vector quantile(const Vector &p) const {
+        Vector result(p.size());
+        quantile(p.data(), p.size(), result.data());
+        return result;
+      }
+
+      Matrix quantile(const Matrix &p) const {
+        Matrix result(p.nrows(), p.ncols());
+        quantile(p.data(), p.size(), result.data());
+        return result;
       }
 
       static Gaussian fit(const Vector &data){
@@ -205,10 +1237,53 @@ namespace pml {
     public:
       Poisson(double lambda_) : lambda(lambda_) {}
 
-      double randgen() const override {
-        return gsl_ran_poisson(rnd_get_rng(), lambda);
+      using Distribution1D::randgen;
+
+      double randgen(Generator &gen) const override {
+        return gsl_ran_poisson(gen.rng(), lambda);
       }
 
+      // For small lambda, inverts a table of the CDF with one uniform per
+      // sample. The table ends where the remaining tail is below double
+      // precision.
+      void randgen(double *out, size_t n, Generator &gen) const override {
+        if(lambda > MAX_TABLE_LAMBDA){
+          Distribution1D::randgen(out, n, gen);
+          return;
+        }
+        std::vector<double> cdf;
+        double pmf = std::exp(-lambda), total = pmf;
+        cdf.push_back(total);
+        for(size_t k = 1; 1 - total > 1e-16; ++k){
+          pmf *= lambda / k;
+          total += pmf;
+          if(pmf == 0)
+            break;
+          cdf.push_back(total);
+        }
+        gen.uniform(out, n);
+        for(size_t i = 0; i < n; ++i)
+          out[i] = std::upper_bound(cdf.begin(), cdf.end() - 1, out[i]) -
+                   cdf.begin();
+      }
+
+      using Distribution1D::log_pdf;
+
+      void log_pdf(const double *x, size_t n, double *out) const override {
+        const double inf = std::numeric_limits<double>::infinity();
+        double log_lambda = std::log(lambda);
+        for(size_t i = 0; i < n; ++i){
+          if(is_count(x[i]))
+            out[i] = (x[i] > 0 ? x[i] * log_lambda : 0) - lambda -
+                     log_factorial(x[i]);
+          else
+            out[i] = -inf;
+        }
+      }
+
+    private:
+      static constexpr double MAX_TABLE_LAMBDA = 64;
+
     public:
       double lambda;
   };
@@ -224,8 +1299,26 @@ namespace pml {
     public:
       Gamma(double a_, double b_) : a(a_), b(b_) {}
 
-      double randgen() const override {
-        return gsl_ran_gamma_knuth(rnd_get_rng(), a, b);
+      using Distribution1D::randgen;
+
+      double randgen(Generator &gen) const override {
+        return b * standard_gamma(a, gen);
+      }
+
+      void randgen(double *out, size_t n, Generator &gen) const override {
+        standard_gamma(a, out, n, gen);
+        for(size_t i = 0; i < n; ++i)
+          out[i] *= b;
+      }
+
+      using Distribution1D::log_pdf;
+
+      void log_pdf(const double *x, size_t n, double *out) const override {
+        const double inf = std::numeric_limits<double>::infinity();
+        double log_norm = -gammaln(a) - a * std::log(b);
+        for(size_t i = 0; i < n; ++i)
+          out[i] = x[i] > 0 ? (a - 1) * std::log(x[i]) - x[i] / b + log_norm
+                            : -inf;
       }
 
       static Gamma fit(const Vector &data, double scale = 0){
@@ -275,23 +1368,77 @@ namespace pml {
 
   class Dirichlet : public DistributionND {
     private:
-      static const size_t MIN_ITER = 1;
       static const size_t MAX_ITER = 1000;
+      static constexpr double TOLERANCE = 1e-12;
 
     public:
       Dirichlet(const Vector &alpha_) : alpha(alpha_) { }
 
-      Vector randgen() override {
+      size_t dim() const override {
+        return alpha.size();
+      }
+
+      using DistributionND::randgen;
+
+      Vector randgen(Generator &gen) override {
         Vector result(alpha.size());
-        gsl_ran_dirichlet(rnd_get_rng(), alpha.size(),
-                          alpha.data(), result.data());
+        randgen(result.data(), 1, gen);
         return result;
       }
 
+      // Normalized Gamma(alpha_k) samples. Each row is drawn in batches
+      // for all columns, then the columns are normalized. Columns where
+      // every component underflowed, which happens for tiny alphas, are
+      // redrawn.
+      void randgen(double *out, size_t ncols, Generator &gen) override {
+        const size_t BLOCK = 256;
+        size_t K = alpha.size();
+        double buffer[BLOCK];
+        for(size_t k = 0; k < K; ++k){
+          for(size_t start = 0; start < ncols; start += BLOCK){
+            size_t m = std::min(BLOCK, ncols - start);
+            standard_gamma(alpha[k], buffer, m, gen);
+            for(size_t i = 0; i < m; ++i)
+              out[(start + i) * K + k] = buffer[i];
+          }
+        }
+        for(size_t j = 0; j < ncols; ++j){
+          double *x = out + j * K;
+          double total = 0;
+          for(size_t k = 0; k < K; ++k)
+            total += x[k];
+          while(total == 0){
+            for(size_t k = 0; k < K; ++k)
+              total += (x[k] = standard_gamma(alpha[k], gen));
+          }
+          for(size_t k = 0; k < K; ++k)
+            x[k] /= total;
+        }
+      }
+
+      // log p(x) = log Gamma(sum(alpha)) - sum log Gamma(alpha_k)
+      //            + sum (alpha_k - 1) log(x_k)
+      using DistributionND::log_pdf;
+
+      void log_pdf(const double *X, size_t ncols, double *out) const override {
+        size_t K = alpha.size();
+        double log_norm = -log_beta(alpha);
+        Vector am1 = alpha - 1;
+        for(size_t j = 0; j < ncols; ++j){
+          const double *x = X + j * K;
+          double result = log_norm;
+          for(size_t k = 0; k < K; ++k)
+            result += am1[k] == 0 ? 0 : am1[k] * std::log(x[k]);
+          out[j] = result;
+        }
+      }
+
+      // Fits to the columns of data.
       static Dirichlet fit(const Matrix &data, double precision = 0){
-        return fit( mean(log(data),1), precision);
+        return fit(mean_log(data), precision);
       }
 
+      // Fits to the sufficient statistics ss = mean(log(data), 1).
       static Dirichlet fit(const Vector &ss, double precision = 0){
         if(precision > 0)
           return fit_mean(ss, precision);
@@ -299,36 +1446,524 @@ namespace pml {
       }
 
     private:
+      // mean(log(data), 1) in one parallel pass. Blocks of columns are
+      // summed separately and then added in order, so the result does not
+      // depend on the number of threads.
+      static Vector mean_log(const Matrix &data){
+        const size_t BLOCK = 1024;
+        size_t K = data.nrows(), N = data.ncols();
+        size_t num_blocks = (N + BLOCK - 1) / BLOCK;
+        Matrix partial(K, num_blocks);
+        parallel_for(num_blocks, 1, [&](size_t start, size_t stop){
+          for(size_t b = start; b < stop; ++b){
+            double *total = partial.data() + b * K;
+            size_t last = std::min(N, (b + 1) * BLOCK);
+            for(size_t j = b * BLOCK; j < last; ++j){
+              const double *x = data.data() + j * K;
+              for(size_t k = 0; k < K; ++k)
+                total[k] += std::log(x[k]);
+            }
+          }
+        });
+        Vector result(K);
+        for(size_t b = 0; b < num_blocks; ++b)
+          for(size_t k = 0; k < K; ++k)
+            result[k] += partial(k, b);
+        return result / N;
+      }
+
+      // Minka's Newton iteration. The Hessian of the log likelihood is
+      // diag(q) + z 11', so the Newton step is (g - b) / q in O(K), with
+      // g the gradient and b = sum(g / q) / (1 / z + sum(1 / q)).
+      // Steps are halved whenever they would leave alpha > 0.
       static Dirichlet fit_all(const Vector &ss){
+        size_t K = ss.size();
         Vector alpha = normalize(ss);
-        Vector alpha_new;
+        Vector step(K), q(K);
         for(size_t iter=0; iter < MAX_ITER; iter++) {
-          alpha_new = inv_psi( ss + psi(sum(alpha)) );
+          double total = sum(alpha);
+          double psi_total = psi(total), z = psi(total, 1);
+          double sum_gq = 0, sum_1q = 0;
+          for(size_t k = 0; k < K; ++k){
+            q[k] = -psi(alpha[k], 1);
+            step[k] = (psi_total - psi(alpha[k]) + ss[k]) / q[k];
+            sum_gq += step[k];
+            sum_1q += 1 / q[k];
+          }
+          double b = sum_gq / (1 / z + sum_1q);
+          for(size_t k = 0; k < K; ++k)
+            step[k] -= b / q[k];
+          double scale = 1;
+          for(size_t k = 0; k < K; ++k)
+            while(alpha[k] - scale * step[k] <= 0 && scale > 1e-20)
+              scale /= 2;
+          double change = 0;
+          for(size_t k = 0; k < K; ++k){
+            alpha[k] -= scale * step[k];
+            change += std::fabs(scale * step[k]);
+          }
           // Break if converged.
-          if( iter > MIN_ITER && sum(abs(alpha-alpha_new)) < 1e-6 )
+          if(change < TOLERANCE * total)
             break;
-          alpha = alpha_new;
         }
         return Dirichlet(alpha);
       }
 
+      // Fixed point iteration for the mean m with the precision fixed,
+      // alpha = precision * m, without temporary Vectors.
       static Dirichlet fit_mean(const Vector &ss, double precision){
+        size_t K = ss.size();
         Vector m = normalizeExp(ss);
-        Vector m_new;
+        Vector m_new(K);
         for(size_t iter=0; iter < MAX_ITER; iter++) {
-          m_new = normalize(inv_psi(ss - dot(m , ss - psi(precision * m))));
-          if( iter > 10 && sum(abs(m-m_new)) < 1e-6 )
+          double c = 0;
+          for(size_t k = 0; k < K; ++k)
+            c += m[k] * (ss[k] - psi(precision * m[k]));
+          for(size_t k = 0; k < K; ++k)
+            m_new[k] = ss[k] - c;
+          inv_psi(m_new.data(), K, m_new.data());
+          double total = 0;
+          for(size_t k = 0; k < K; ++k)
+            total += m_new[k];
+          double change = 0;
+          for(size_t k = 0; k < K; ++k){
+            m_new[k] /= total;
+            change += std::fabs(m[k] - m_new[k]);
+          }
+          std::swap(m, m_new);
+          if( iter > 10 && change < 1e-6 )
             break;
-          m = m_new;
         }
         return Dirichlet(precision * m);
       }
 
-
     public:
       Vector alpha;
   };
 
+  // ------- Permutations and subsets -------
+
+  // Permutations of at least this size are generated in parallel.
+  const size_t PARALLEL_PERMUTATION_SIZE = 1 << 20;
+
+  // Fisher-Yates shuffle of first[0, n).
+  template <typename T>
+  inline void fisher_yates(T *first, size_t n, Generator &gen) {
+    for(size_t i = n; i > 1; --i)
+      std::swap(first[i-1], first[gen.uniform_int(i)]);
+  }
+
+  // Random permutation of 0, ..., n-1.
+  //
+  // Large permutations use one pass of the Rao-Sandelius method: each
+  // element goes to one of 256 random buckets, the buckets are laid out in
+  // order, and each bucket is shuffled on its own. Both steps run in
+  // parallel on Philox streams of a seed taken from gen, so the result
+  // does not depend on the number of threads.
+  inline std::vector<size_t> randperm(size_t n, Generator &gen) {
+    std::vector<size_t> perm(n);
+    if(n < PARALLEL_PERMUTATION_SIZE){
+      for(size_t i = 0; i < n; ++i)
+        perm[i] = i;
+      fisher_yates(perm.data(), n, gen);
+      return perm;
+    }
+    const size_t BLOCK = 1 << 16, NUM_BUCKETS = 256;
+    uint64_t seed = gen.next();
+    size_t num_blocks = (n + BLOCK - 1) / BLOCK;
+    std::vector<uint8_t> bucket(n);
+    std::vector<size_t> offsets(num_blocks * NUM_BUCKETS, 0);
+    parallel_for(num_blocks, 1, [&](size_t start, size_t stop){
+      for(size_t b = start; b < stop; ++b){
+        Generator block_gen = Generator::philox(seed, b);
+        size_t *counts = &offsets[b * NUM_BUCKETS];
+        for(size_t i = b * BLOCK; i < std::min(n, (b + 1) * BLOCK); ++i){
+          bucket[i] = block_gen.next() >> 56;
+          ++counts[bucket[i]];
+        }
+      }
+    });
+    // Each bucket holds the elements of block 0, then block 1, and so on.
+    std::vector<size_t> bucket_start(NUM_BUCKETS + 1);
+    size_t total = 0;
+    for(size_t r = 0; r < NUM_BUCKETS; ++r){
+      bucket_start[r] = total;
+      for(size_t b = 0; b < num_blocks; ++b){
+        size_t count = offsets[b * NUM_BUCKETS + r];
+        offsets[b * NUM_BUCKETS + r] = total;
+        total += count;
+      }
+    }
+    bucket_start[NUM_BUCKETS] = n;
+    parallel_for(num_blocks, 1, [&](size_t start, size_t stop){
+      for(size_t b = start; b < stop; ++b){
+        size_t *next = &offsets[b * NUM_BUCKETS];
+        for(size_t i = b * BLOCK; i < std::min(n, (b + 1) * BLOCK); ++i)
+          perm[next[bucket[i]]++] = i;
+      }
+    });
+    parallel_for(NUM_BUCKETS, 1, [&](size_t start, size_t stop){
+      for(size_t r = start; r < stop; ++r){
+        Generator bucket_gen = Generator::philox(seed, num_blocks + r);
+        fisher_yates(&perm[bucket_start[r]],
+                     bucket_start[r+1] - bucket_start[r], bucket_gen);
+      }
+    });
+    return perm;
+  }
+
+  inline std::vector<size_t> randperm(size_t n) {
+    return randperm(n, rnd_get_generator());
+  }
+
+  // Moves column perm[j] of X to column j, following the cycles of the
+  // permutation with a single column of extra memory.
+  inline void permute_columns(Matrix &X, const std::vector<size_t> &perm) {
+    ASSERT_TRUE(perm.size() == X.ncols(),
+                "permute_columns:: Permutation size mismatch.");
+    size_t nrows = X.nrows();
+    std::vector<bool> done(perm.size(), false);
+    std::vector<double> buffer(nrows);
+    double *data = X.data();
+    for(size_t start = 0; start < perm.size(); ++start){
+      if(done[start] || perm[start] == start)
+        continue;
+      std::copy(data + start * nrows, data + (start + 1) * nrows,
+                buffer.begin());
+      size_t j = start;
+      while(perm[j] != start){
+        std::copy(data + perm[j] * nrows, data + (perm[j] + 1) * nrows,
+                  data + j * nrows);
+        done[j] = true;
+        j = perm[j];
+      }
+      std::copy(buffer.begin(), buffer.end(), data + j * nrows);
+      done[j] = true;
+    }
+  }
+
+  // Shuffles v in place.
+  inline void shuffle(Vector &v, Generator &gen) {
+    if(v.size() < PARALLEL_PERMUTATION_SIZE){
+      fisher_yates(v.data(), v.size(), gen);
+      return;
+    }
+    std::vector<size_t> perm = randperm(v.size(), gen);
+    std::vector<bool> done(perm.size(), false);
+    for(size_t start = 0; start < perm.size(); ++start){
+      if(done[start])
+        continue;
+      double first = v[start];
+      size_t j = start;
+      for(; perm[j] != start; j = perm[j]){
+        v[j] = v[perm[j]];
+        done[j] = true;
+      }
+      v[j] = first;
+      done[j] = true;
+    }
+  }
+
+  inline void shuffle(Vector &v) {
+    shuffle(v, rnd_get_generator());
+  }
+
+  // Shuffles the columns of X in place.
+  inline void shuffle_columns(Matrix &X, Generator &gen) {
+    permute_columns(X, randperm(X.ncols(), gen));
+  }
+
+  inline void shuffle_columns(Matrix &X) {
+    shuffle_columns(X, rnd_get_generator());
+  }
+
+  // k distinct elements of 0, ..., n-1, in random order. For k much
+  // smaller than n, Floyd's algorithm takes O(k) time and memory;
+  // otherwise the first k steps of a Fisher-Yates shuffle are used.
+  inline std::vector<size_t> randsample(size_t n, size_t k, Generator &gen) {
+    ASSERT_TRUE(k <= n, "randsample:: Cannot sample more than n elements.");
+    std::vector<size_t> result;
+    if(k * 16 < n){
+      std::unordered_set<size_t> chosen(2 * k);
+      result.reserve(k);
+      for(size_t j = n - k; j < n; ++j){
+        size_t t = gen.uniform_int(j + 1);
+        if(!chosen.insert(t).second){
+          chosen.insert(j);
+          result.push_back(j);
+        } else {
+          result.push_back(t);
+        }
+      }
+      fisher_yates(result.data(), k, gen);
+      return result;
+    }
+    result.resize(n);
+    for(size_t i = 0; i < n; ++i)
+      result[i] = i;
+    for(size_t i = 0; i < k; ++i)
+      std::swap(result[i], result[i + gen.uniform_int(n - i)]);
+    result.resize(k);
+    return result;
+  }
+
+  inline std::vector<size_t> randsample(size_t n, size_t k) {
+    return randsample(n, k, rnd_get_generator());
+  }
+
+  // k distinct indices drawn without replacement with probabilities
+  // proportional to the weights, in the order they are drawn.
+  // Efraimidis-Spirakis: the k largest keys log(u_i) / w_i. Keys are
+  // generated in parallel blocks on Philox streams of a seed taken from
+  // gen, and the top k are selected in O(n).
+  inline std::vector<size_t> randsample(const Vector &weights, size_t k,
+                                        Generator &gen) {
+    const size_t BLOCK = 1 << 16;
+    size_t n = weights.size();
+    size_t num_positive = 0;
+    for(double w : weights){
+      ASSERT_TRUE(w >= 0, "randsample:: Negative weight.");
+      num_positive += w > 0;
+    }
+    ASSERT_TRUE(k <= num_positive,
+                "randsample:: Not enough elements with positive weight.");
+    uint64_t seed = gen.next();
+    std::vector<std::pair<double, size_t>> keys(n);
+    size_t num_blocks = (n + BLOCK - 1) / BLOCK;
+    parallel_for(num_blocks, 1, [&](size_t start, size_t stop){
+      const double inf = std::numeric_limits<double>::infinity();
+      for(size_t b = start; b < stop; ++b){
+        Generator block_gen = Generator::philox(seed, b);
+        for(size_t i = b * BLOCK; i < std::min(n, (b + 1) * BLOCK); ++i){
+          double u = 1 - block_gen.uniform();
+          keys[i].first = weights[i] > 0 ? std::log(u) / weights[i] : -inf;
+          keys[i].second = i;
+        }
+      }
+    });
+    auto larger = [](const std::pair<double, size_t> &a,
+                     const std::pair<double, size_t> &b){
+      return a.first > b.first || (a.first == b.first && a.second < b.second);
+    };
+    std::nth_element(keys.begin(), keys.begin() + k, keys.end(), larger);
+    std::sort(keys.begin(), keys.begin() + k, larger);
+    std::vector<size_t> result(k);
+    for(size_t i = 0; i < k; ++i)
+      result[i] = keys[i].second;
+    return result;
+  }
+
+  inline std::vector<size_t> randsample(const Vector &weights, size_t k) {
+    return randsample(weights, k, rnd_get_generator());
+  }
+
+  // ------- Sufficient statistics -------
+  //
+  // Accumulators collect the sufficient statistics of a family from data
+  // given in chunks, and fit() passes them to the family's fit routine, so
+  // fitting runs in constant memory. Accumulators of different chunks,
+  // threads or machines are combined with merge(). serialize() packs the
+  // statistics into a short Vector, which deserialize() restores.
+
+  // Count, mean and sum of squared deviations, merged with Chan's formula.
+  class GaussianStats {
+    public:
+      GaussianStats() : n(0), mean(0), m2(0) {}
+
+      void add(double x) {
+        n += 1;
+        double delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+      }
+
+      // Two passes over the chunk, then a merge.
+      void add(const Vector &x) {
+        if(x.empty())
+          return;
+        GaussianStats chunk;
+        chunk.n = x.size();
+        chunk.mean = pml::mean(x);
+        for(double d : x)
+          chunk.m2 += (d - chunk.mean) * (d - chunk.mean);
+        merge(chunk);
+      }
+
+      void merge(const GaussianStats &that) {
+        if(that.n == 0)
+          return;
+        double total = n + that.n;
+        double delta = that.mean - mean;
+        mean += delta * that.n / total;
+        m2 += that.m2 + delta * delta * n * that.n / total;
+        n = total;
+      }
+
+      Gaussian fit() const {
+        return Gaussian::fit(mean, m2 / n);
+      }
+
+      Vector serialize() const {
+        return Vector({n, mean, m2});
+      }
+
+      static GaussianStats deserialize(const Vector &v) {
+        ASSERT_TRUE(v.size() == 3, "GaussianStats:: Invalid statistics.");
+        GaussianStats result;
+        result.n = v[0];
+        result.mean = v[1];
+        result.m2 = v[2];
+        return result;
+      }
+
+    public:
+      double n, mean, m2;
+  };
+
+  // Count, sum(x) and sum(log(x)).
+  class GammaStats {
+    public:
+      GammaStats() : n(0), sum_x(0), sum_log_x(0) {}
+
+      void add(double x) {
+        n += 1;
+        sum_x += x;
+        sum_log_x += std::log(x);
+      }
+
+      void add(const Vector &x) {
+        for(double d : x)
+          add(d);
+      }
+
+      void merge(const GammaStats &that) {
+        n += that.n;
+        sum_x += that.sum_x;
+        sum_log_x += that.sum_log_x;
+      }
+
+      // If scale > 0, only the shape is fitted.
+      Gamma fit(double scale = 0) const {
+        return Gamma::fit(sum_x / n, sum_log_x / n, scale);
+      }
+
+      Vector serialize() const {
+        return Vector({n, sum_x, sum_log_x});
+      }
+
+      static GammaStats deserialize(const Vector &v) {
+        ASSERT_TRUE(v.size() == 3, "GammaStats:: Invalid statistics.");
+        GammaStats result;
+        result.n = v[0];
+        result.sum_x = v[1];
+        result.sum_log_x = v[2];
+        return result;
+      }
+
+    public:
+      double n, sum_x, sum_log_x;
+  };
+
+  // Count and sum(log(x)) of K dimensional samples.
+  class DirichletStats {
+    public:
+      explicit DirichletStats(size_t K) : n(0), sum_log_x(K, 0.0) {}
+
+      void add(const Vector &x) {
+        ASSERT_TRUE(x.size() == sum_log_x.size(),
+                    "DirichletStats:: Dimension mismatch.");
+        n += 1;
+        for(size_t k = 0; k < x.size(); ++k)
+          sum_log_x[k] += std::log(x[k]);
+      }
+
+      // Adds the columns of X.
+      void add(const Matrix &X) {
+        ASSERT_TRUE(X.nrows() == sum_log_x.size(),
+                    "DirichletStats:: Dimension mismatch.");
+        size_t K = X.nrows();
+        for(size_t j = 0; j < X.ncols(); ++j){
+          const double *x = X.data() + j * K;
+          for(size_t k = 0; k < K; ++k)
+            sum_log_x[k] += std::log(x[k]);
+        }
+        n += X.ncols();
+      }
+
+      void merge(const DirichletStats &that) {
+        ASSERT_TRUE(that.sum_log_x.size() == sum_log_x.size(),
+                    "DirichletStats:: Dimension mismatch.");
+        n += that.n;
+        sum_log_x += that.sum_log_x;
+      }
+
+      // If precision > 0, only the mean is fitted.
+      Dirichlet fit(double precision = 0) const {
+        return Dirichlet::fit(sum_log_x / n, precision);
+      }
+
+      Vector serialize() const {
+        Vector result(sum_log_x.size() + 1);
+        result[0] = n;
+        memcpy(result.data() + 1, sum_log_x.data(),
+               sizeof(double) * sum_log_x.size());
+        return result;
+      }
+
+      static DirichletStats deserialize(const Vector &v) {
+        ASSERT_TRUE(v.size() > 1, "DirichletStats:: Invalid statistics.");
+        DirichletStats result(v.size() - 1);
+        result.n = v[0];
+        memcpy(result.sum_log_x.data(), v.data() + 1,
+               sizeof(double) * (v.size() - 1));
+        return result;
+      }
+
+    public:
+      double n;
+      Vector sum_log_x;
+  };
+
+  // Counts of the K categories.
+  class CategoricalStats {
+    public:
+      explicit CategoricalStats(size_t K) : counts(K, 0.0) {}
+
+      void add(double x) {
+        ASSERT_TRUE(is_count(x) && x < counts.size(),
+                    "CategoricalStats:: Invalid category.");
+        counts[x] += 1;
+      }
+
+      void add(const Vector &x) {
+        for(double d : x)
+          add(d);
+      }
+
+      void merge(const CategoricalStats &that) {
+        ASSERT_TRUE(that.counts.size() == counts.size(),
+                    "CategoricalStats:: Dimension mismatch.");
+        counts += that.counts;
+      }
+
+      Categorical fit() const {
+        return Categorical(counts);
+      }
+
+      Vector serialize() const {
+        return counts;
+      }
+
+      static CategoricalStats deserialize(const Vector &v) {
+        CategoricalStats result(v.size());
+        result.counts = v;
+        return result;
+      }
+
+    public:
+      Vector counts;
+  };
+
 } // pml
 
 #endif // MATLIB_PML_RAND_H
\ No newline at end of file
@@ -0,0 +1,179 @@
+#ifndef PML_SHM_H_
+#define PML_SHM_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pml_matrix.hpp"
+
+namespace pml {
+
+  // ------- Matrices in POSIX shared memory -------
+  //
+  // shm_publish copies a Matrix into a named shared memory segment, and
+  // other processes on the host map the same pages read-only with
+  // shm_attach instead of loading their own copies.
+  //
+  // A segment is a header page followed by the column major data. The
+  // header holds the shape and a reference count of the processes using the
+  // segment. The views returned by shm_publish and shm_attach hold one
+  // reference; when the last one is released the name is unlinked and the
+  // memory is freed once every process has unmapped it. Segments left by
+  // crashed processes can be removed with shm_remove.
+
+  struct ShmHeader {
+    char magic[4];
+    uint32_t version;
+    std::atomic<uint32_t> refcount;   // 0 while being created or destroyed
+    uint64_t nrows;
+    uint64_t ncols;
+  };
+
+  const char SHM_MAGIC[4] = {'P', 'M', 'L', 'S'};
+  const uint32_t SHM_VERSION = 1;
+
+  // A mapped segment. Releases its reference when destroyed.
+  class ShmSegment {
+    public:
+      ShmSegment(const std::string &name_, ShmHeader *header_,
+                 const double *data_, size_t data_size_)
+          : name(name_), header(header_), data(data_),
+            data_size(data_size_) {}
+
+      ShmSegment(const ShmSegment &) = delete;
+      ShmSegment& operator=(const ShmSegment &) = delete;
+
+      ~ShmSegment() {
+        if (header->refcount.fetch_sub(1) == 1)
+          shm_unlink(name.c_str());
+        if (data_size > 0)
+          munmap(const_cast<double*>(data), data_size);
+        munmap(header, page_size());
+      }
+
+      static size_t page_size() {
+        return sysconf(_SC_PAGESIZE);
+      }
+
+    public:
+      std::string name;
+      ShmHeader *header;
+      const double *data;
+      size_t data_size;
+  };
+
+  // POSIX shared memory names start with a single '/'.
+  inline std::string shm_name(const std::string &name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+  }
+
+  // Removes the named segment. Processes that already attached keep
+  // their mappings.
+  inline bool shm_remove(const std::string &name) {
+    return shm_unlink(shm_name(name).c_str()) == 0;
+  }
+
+  // Publishes a copy of m under the given name. Returns an empty view if a
+  // segment with that name already exists. The segment lives as long as
+  // the returned view, its copies, or any attached view.
+  inline MatrixView shm_publish(const std::string &name, const Matrix &m) {
+    std::string path = shm_name(name);
+    int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+      return MatrixView();
+    size_t page = ShmSegment::page_size();
+    size_t data_size = sizeof(double) * m.size();
+    if (ftruncate(fd, page + data_size) != 0) {
+      close(fd);
+      shm_unlink(path.c_str());
+      return MatrixView();
+    }
+    void *header_addr = mmap(nullptr, page, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fd, 0);
+    void *data_addr = data_size == 0 ? nullptr :
+        mmap(nullptr, data_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, page);
+    close(fd);
+    if (header_addr == MAP_FAILED || data_addr == MAP_FAILED) {
+      if (header_addr != MAP_FAILED)
+        munmap(header_addr, page);
+      shm_unlink(path.c_str());
+      return MatrixView();
+    }
+    ShmHeader *header = static_cast<ShmHeader*>(header_addr);
+    memcpy(header->magic, SHM_MAGIC, sizeof(SHM_MAGIC));
+    header->version = SHM_VERSION;
+    header->nrows = m.nrows();
+    header->ncols = m.ncols();
+    if (data_size > 0) {
+      memcpy(data_addr, m.data(), data_size);
+      mprotect(data_addr, data_size, PROT_READ);
+    }
+    // Readers can attach from now on.
+    header->refcount.store(1, std::memory_order_release);
+    auto segment = std::make_shared<ShmSegment>(
+        path, header, static_cast<const double*>(data_addr), data_size);
+    return MatrixView(m.nrows(), m.ncols(), segment->data, segment);
+  }
+
+  // Publishes v as a single column Matrix.
+  inline MatrixView shm_publish(const std::string &name, const Vector &v) {
+    return shm_publish(name, Matrix(v.size(), 1, v.data()));
+  }
+
+  // Maps a published Matrix read-only. Returns an empty view if there is no
+  // such segment, or it is still being created.
+  inline MatrixView shm_attach(const std::string &name) {
+    std::string path = shm_name(name);
+    int fd = shm_open(path.c_str(), O_RDWR, 0);
+    if (fd < 0)
+      return MatrixView();
+    size_t page = ShmSegment::page_size();
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < page) {
+      close(fd);
+      return MatrixView();
+    }
+    // Only the header is writable, for the reference count.
+    void *header_addr = mmap(nullptr, page, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fd, 0);
+    if (header_addr == MAP_FAILED) {
+      close(fd);
+      return MatrixView();
+    }
+    ShmHeader *header = static_cast<ShmHeader*>(header_addr);
+    // Take a reference unless the segment is not ready or already released.
+    uint32_t count = header->refcount.load(std::memory_order_acquire);
+    do {
+      if (count == 0 || memcmp(header->magic, SHM_MAGIC, 4) != 0) {
+        munmap(header_addr, page);
+        close(fd);
+        return MatrixView();
+      }
+    } while (!header->refcount.compare_exchange_weak(count, count + 1));
+    // A truncated segment or a corrupt shape must not map past the end.
+    size_t available = (size_t(st.st_size) - page) / sizeof(double);
+    bool fits = header->nrows == 0 ||
+                header->ncols <= available / header->nrows;
+    size_t data_size = sizeof(double) * header->nrows * header->ncols;
+    void *data_addr = !fits ? MAP_FAILED : data_size == 0 ? nullptr :
+        mmap(nullptr, data_size, PROT_READ, MAP_SHARED, fd, page);
+    close(fd);
+    auto segment = std::make_shared<ShmSegment>(
+        path, header,
+        static_cast<const double*>(data_addr == MAP_FAILED ? nullptr
+                                                           : data_addr),
+        data_addr == MAP_FAILED ? 0 : data_size);
+    if (data_addr == MAP_FAILED)
+      return MatrixView();
+    return MatrixView(header->nrows, header->ncols, segment->data, segment);
+  }
+
+} // namespace pml
+
+#endif // PML_SHM_H_
@@ -1,83 +1,812 @@
 #ifndef PML_SPECIAL_H_
 #define PML_SPECIAL_H_
 
+#include <atomic>
+#include <mutex>
+
 #include "pml_vector.hpp"
 #include "pml_matrix.hpp"
+#include "pml_parallel.hpp"
 
 namespace pml{
 
   // ------- Log Gamma function -------
-  double gammaln(double x){
-    return std::lgamma(x);
+  //
+  // Thread safe replacement for std::lgamma, which sets the global signgam
+  // on glibc. Within 1/4 of the zeros at 1 and 2 a Taylor series in the
+  // offset keeps the relative error small. Other positive x below 3 are
+  // moved to [2, 3) by the recurrence and use a rational approximation
+  // in x - 2 (from Cephes). Larger x are
+  // shifted above 10 and the Stirling series is summed; the absolute
+  // error is a few ulps of log(10!). Negative x use the reflection
+  // formula and the poles, 0, -1, -2, ..., give inf.
+
+  // Stirling series of log Gamma, accurate to double precision for x >= 10.
+  inline double gammaln_series(double x){
+    double y = 1 / x, r = y * y;
+    return (x - 0.5) * std::log(x) - x + 0.5 * std::log(2 * M_PI) +
+        y * (1.0/12 - r * (1.0/360 - r * (1.0/1260 - r * (1.0/1680 -
+        r * (1.0/1188 - r * (691.0/360360 - r * (1.0/156)))))));
+  }
+
+  // log Gamma(2 + t) for |t| <= 1/4 from its Taylor series,
+  // (1 - gamma) t + sum_{k>=2} (-1)^k (zeta(k) - 1) t^k / k.
+  inline double gammaln_near2(double t){
+    static const double C[] = {
+      4.22784335098467139393E-1, 3.22467033424113218236E-1,
+      -6.73523010531980951332E-2, 2.05808084277845478790E-2,
+      -7.38555102867398526627E-3, 2.89051033074152328575E-3,
+      -1.19275391170326097711E-3, 5.09669524743042422336E-4,
+      -2.23154758453579379761E-4, 9.94575127818085337146E-5,
+      -4.49262367381331417002E-5, 2.05072127756706915532E-5,
+      -9.43948827526839590399E-6, 4.37486678990748780418E-6,
+      -2.03921575380136623678E-6, 9.55141213040741983286E-7,
+      -4.49246919876456604329E-7, 2.12071848055546658692E-7,
+      -1.00432248239680996087E-7, 4.76981016936398056576E-8};
+    const int N = sizeof(C) / sizeof(C[0]);
+    double sum = C[N - 1];
+    for(int k = N - 2; k >= 0; --k)
+      sum = sum * t + C[k];
+    return sum * t;
+  }
+
+  // log Gamma(x) for 0 < x < 3.
+  inline double gammaln_small(double x){
+    // Around the zeros at 1 and 2 the result is computed from the offset
+    // to the zero, so it keeps its relative accuracy.
+    if(std::fabs(x - 2) <= 0.25)
+      return gammaln_near2(x - 2);
+    if(std::fabs(x - 1) <= 0.25)
+      return gammaln_near2(x - 1) - std::log1p(x - 1);
+    static const double B[] = {
+      -1.37825152569120859100E3, -3.88016315134637840924E4,
+      -3.31612992738871184744E5, -1.16237097492762307383E6,
+      -1.72173700820839662146E6, -8.53555664245765465627E5};
+    static const double C[] = {
+      -3.51815701436523470549E2, -1.70642106651881159223E4,
+      -2.20528590553854454839E5, -1.13933444367982507207E6,
+      -2.53252307177582951285E6, -2.01889141433532773231E6};
+    double z = 1;
+    for(; x < 2; x += 1)
+      z *= x;
+    double t = x - 2;
+    double p = ((((B[0] * t + B[1]) * t + B[2]) * t + B[3]) * t + B[4]) * t
+               + B[5];
+    double q = (((((t + C[0]) * t + C[1]) * t + C[2]) * t + C[3]) * t + C[4])
+               * t + C[5];
+    return t * p / q - std::log(z);
+  }
+
+  inline double gammaln(double x){
+    if(x <= 0){
+      if(x == std::floor(x))
+        return std::numeric_limits<double>::infinity();
+      // Reduce before multiplying by pi to keep sin accurate near poles.
+      double sin_pi_x = std::sin(M_PI * (x - std::round(x)));
+      return std::log(M_PI / std::fabs(sin_pi_x)) - gammaln(1 - x);
+    }
+    if(x == std::numeric_limits<double>::infinity())
+      return x;
+    if(x < 3)
+      return gammaln_small(x);
+    double product = 1;
+    for(; x < 10; x += 1)
+      product *= x;
+    return gammaln_series(x) - std::log(product);
+  }
+
+  // Batch version. For positive inputs the shift is done in a fixed number
+  // of branch free steps, which the compiler can vectorize.
+  inline void gammaln(const double *x, size_t n, double *out){
+    for(size_t i = 0; i < n; ++i){
+      double y = x[i], product = 1;
+      for(int j = 0; j < 10; ++j){
+        bool small = y < 10;
+        product *= small ? y : 1;
+        y += small ? 1 : 0;
+      }
+      out[i] = gammaln_series(y) - std::log(product);
+    }
+    for(size_t i = 0; i < n; ++i)
+      if(!(x[i] >= 3) || x[i] == std::numeric_limits<double>::infinity())
+        out[i] = gammaln(x[i]);
   }
 
   inline Vector gammaln(const Vector &x){
-    return apply(x, std::lgamma);
+    Vector y(x.size());
+    parallel_for(x.size(), 1 << 14, [&](size_t start, size_t stop){
+      gammaln(x.data() + start, stop - start, y.data() + start);
+    });
+    return y;
   }
 
   inline Matrix gammaln(const Matrix &m){
-    return apply(m, std::lgamma);
+    Matrix y(m.nrows(), m.ncols());
+    parallel_for(m.size(), 1 << 14, [&](size_t start, size_t stop){
+      gammaln(m.data() + start, stop - start, y.data() + start);
+    });
+    return y;
+  }
+
+  // Log of the multivariate Beta function,
+  // sum_k gammaln(alpha_k) - gammaln(sum_k alpha_k): the log normalizer
+  // of a Dirichlet.
+  inline double log_beta(const double *alpha, size_t K){
+    const size_t BLOCK = 256;
+    double buffer[BLOCK];
+    double result = 0, total = 0;
+    for(size_t first = 0; first < K; first += BLOCK){
+      size_t m = std::min(BLOCK, K - first);
+      gammaln(alpha + first, m, buffer);
+      for(size_t k = 0; k < m; ++k){
+        result += buffer[k];
+        total += alpha[first + k];
+      }
+    }
+    return result - gammaln(total);
+  }
+
+  inline double log_beta(const Vector &alpha){
+    return log_beta(alpha.data(), alpha.size());
+  }
+
+  // log_beta of each column.
+  inline Vector log_beta(const Matrix &alpha){
+    Vector result(alpha.ncols());
+    parallel_for(alpha.ncols(), 64, [&](size_t start, size_t stop){
+      for(size_t j = start; j < stop; ++j)
+        result[j] = log_beta(alpha.data() + j * alpha.nrows(), alpha.nrows());
+    });
+    return result;
+  }
+
+  // Log of the multivariate Gamma function of dimension p,
+  // p(p-1)/4 log(pi) + sum_{j=1}^p gammaln(a + (1-j)/2).
+  inline double multi_gammaln(double a, size_t p){
+    double result = 0.25 * p * (p - 1.0) * std::log(M_PI);
+    for(size_t j = 0; j < p; ++j)
+      result += gammaln(a - 0.5 * j);
+    return result;
+  }
+
+  inline Vector multi_gammaln(const Vector &x, size_t p){
+    Vector y(x.size());
+    parallel_for(x.size(), 1 << 12, [&](size_t start, size_t stop){
+      for(size_t i = start; i < stop; ++i)
+        y[i] = multi_gammaln(x[i], p);
+    });
+    return y;
+  }
+
+  inline Matrix multi_gammaln(const Matrix &m, size_t p){
+    Matrix y(m.nrows(), m.ncols());
+    parallel_for(m.size(), 1 << 12, [&](size_t start, size_t stop){
+      for(size_t i = start; i < stop; ++i)
+        y[i] = multi_gammaln(m[i], p);
+    });
+    return y;
   }
 
   // -------  Polygamma Function -------
-  inline double psi(double d, int n = 0){
-    if( d == 0){
-      std::cout << "n is zero!!\n";
+  //
+  // Shifts x above a threshold with the recurrence
+  // psi(x) = psi(x+1) - 1/x, then sums the asymptotic series. Negative x
+  // use the reflection formula. The poles, 0, -1, -2, ..., give NaN.
+
+  // Asymptotic series of digamma, accurate to double precision for x >= 10.
+  inline double digamma_series(double x){
+    double r = 1 / (x * x);
+    return std::log(x) - 0.5 / x -
+        r * (1.0/12 - r * (1.0/120 - r * (1.0/252 - r * (1.0/240 -
+        r * (1.0/132 - r * (691.0/32760))))));
+  }
+
+  // Asymptotic series of trigamma, accurate to double precision for x >= 10.
+  inline double trigamma_series(double x){
+    double y = 1 / x, r = y * y;
+    return y + 0.5 * r + y * r * (1.0/6 - r * (1.0/30 - r * (1.0/42 -
+        r * (1.0/30 - r * (5.0/66 - r * (691.0/2730 - r * (7.0/6)))))));
+  }
+
+  inline double digamma(double x){
+    if(x <= 0){
+      if(x == std::floor(x))
+        return std::numeric_limits<double>::quiet_NaN();
+      return digamma(1 - x) - M_PI / std::tan(M_PI * x);
     }
+    double result = 0;
+    for(; x < 10; x += 1)
+      result -= 1 / x;
+    return result + digamma_series(x);
+  }
+
+  inline double trigamma(double x){
+    if(x <= 0){
+      if(x == std::floor(x))
+        return std::numeric_limits<double>::quiet_NaN();
+      double s = std::sin(M_PI * x);
+      return M_PI * M_PI / (s * s) - trigamma(1 - x);
+    }
+    double result = 0;
+    for(; x < 10; x += 1)
+      result += 1 / (x * x);
+    return result + trigamma_series(x);
+  }
+
+  // Polygamma function of order n for x > 0.
+  inline double polygamma(int n, double x){
+    if(n == 0) return digamma(x);
+    if(n == 1) return trigamma(x);
+    if(!(x > 0))
+      return std::numeric_limits<double>::quiet_NaN();
+    static const double bernoulli[] = {1.0/6, -1.0/30, 1.0/42, -1.0/30,
+                                       5.0/66, -691.0/2730, 7.0/6,
+                                       -3617.0/510};
+    double factorial = 1;   // n!
+    for(int i = 2; i <= n; ++i)
+      factorial *= i;
+    double result = 0;
+    for(; x < n + 10; x += 1)
+      result += factorial / std::pow(x, n + 1);
+    // (n-1)!/x^n + n!/(2 x^(n+1)) + sum_k B_2k (2k+n-1)! / ((2k)! x^(2k+n))
+    double term = factorial / n / std::pow(x, n);
+    result += term + 0.5 * factorial / std::pow(x, n + 1);
+    for(int k = 1; k <= 8; ++k){
+      term *= (2.0*k + n - 1) * (2.0*k + n - 2) / ((2.0*k) * (2.0*k - 1) * x * x);
+      result += bernoulli[k-1] * term;
+    }
+    return n % 2 ? result : -result;
+  }
+
+  // Batch versions. For positive inputs the shift is done in a fixed
+  // number of branch free steps, which the compiler can vectorize;
+  // other inputs go through the scalar functions.
+  inline void digamma(const double *x, size_t n, double *out){
+    for(size_t i = 0; i < n; ++i){
+      double y = x[i], shift = 0;
+      for(int j = 0; j < 10; ++j){
+        bool small = y < 10;
+        shift += small ? 1 / y : 0;
+        y += small ? 1 : 0;
+      }
+      out[i] = digamma_series(y) - shift;
+    }
+    for(size_t i = 0; i < n; ++i)
+      if(!(x[i] > 0))
+        out[i] = digamma(x[i]);
+  }
+
+  inline void trigamma(const double *x, size_t n, double *out){
+    for(size_t i = 0; i < n; ++i){
+      double y = x[i], shift = 0;
+      for(int j = 0; j < 10; ++j){
+        bool small = y < 10;
+        shift += small ? 1 / (y * y) : 0;
+        y += small ? 1 : 0;
+      }
+      out[i] = trigamma_series(y) + shift;
+    }
+    for(size_t i = 0; i < n; ++i)
+      if(!(x[i] > 0))
+        out[i] = trigamma(x[i]);
+  }
 
-    return gsl_sf_psi_n(n, d);
+  inline void polygamma(int order, const double *x, size_t n, double *out){
+    if(order == 0){
+      digamma(x, n, out);
+    } else if(order == 1){
+      trigamma(x, n, out);
+    } else {
+      for(size_t i = 0; i < n; ++i)
+        out[i] = polygamma(order, x[i]);
+    }
+  }
+
+  inline double psi(double d, int n = 0){
+    return polygamma(n, d);
   }
 
   inline Vector psi(const Vector &x, int n = 0){
-    Vector y = x;
-    for(auto &d : y)
-      d = gsl_sf_psi_n(n, d);
+    Vector y(x.size());
+    parallel_for(x.size(), 1 << 14, [&](size_t start, size_t stop){
+      polygamma(n, x.data() + start, stop - start, y.data() + start);
+    });
     return y;
   }
 
   inline Matrix psi(const Matrix &x, int n = 0){
-    Matrix y = x;
-    for(auto &d : y)
-      d = gsl_sf_psi_n(n, d);
+    Matrix y(x.nrows(), x.ncols());
+    parallel_for(x.size(), 1 << 14, [&](size_t start, size_t stop){
+      polygamma(n, x.data() + start, stop - start, y.data() + start);
+    });
     return y;
   }
 
-  // Inverse Polygamma Function with Newton Method
-  double inv_psi(double d){
-    double x = d > -2.22 ? std::exp(d)+0.5 : -1/(d + 0.577215);
-    // make 5 newton iterations
-    for(int i=0; i < 5; ++i)
-      x -= (psi(x)-d) / psi(x,1);
+  // Digamma and trigamma of x > 0 together, sharing the shift and the
+  // powers of 1/x. Branch free, so it vectorizes in batch loops.
+  inline void digamma_trigamma(double x, double &d0, double &d1){
+    double shift0 = 0, shift1 = 0;
+    for(int j = 0; j < 10; ++j){
+      bool small = x < 10;
+      double inv = 1 / x;
+      shift0 += small ? inv : 0;
+      shift1 += small ? inv * inv : 0;
+      x += small ? 1 : 0;
+    }
+    double y = 1 / x, r = y * y;
+    d0 = std::log(x) - 0.5 * y - shift0 -
+        r * (1.0/12 - r * (1.0/120 - r * (1.0/252 - r * (1.0/240 -
+        r * (1.0/132 - r * (691.0/32760))))));
+    d1 = y + 0.5 * r + shift1 + y * r * (1.0/6 - r * (1.0/30 - r * (1.0/42 -
+        r * (1.0/30 - r * (5.0/66 - r * (691.0/2730 - r * (7.0/6)))))));
+  }
+
+  // Inverse digamma with Newton's method, starting from Minka's initial
+  // guess. Blocks of inputs are iterated together, but each input stops
+  // once its own relative step is below 1e-12, so its result does not
+  // depend on its neighbours. out may equal d.
+  inline void inv_psi(const double *d, size_t n, double *out){
+    const size_t BLOCK = 64;
+    const int MAX_ITER = 10;
+    const double euler = 0.5772156649015329;
+    double x[BLOCK], target[BLOCK];
+    bool active[BLOCK];
+    for(size_t first = 0; first < n; first += BLOCK){
+      size_t m = std::min(BLOCK, n - first);
+      for(size_t i = 0; i < m; ++i){
+        target[i] = d[first + i];
+        x[i] = target[i] >= -2.22 ? std::exp(target[i]) + 0.5
+                                  : -1 / (target[i] + euler);
+        active[i] = true;
+      }
+      for(int iter = 0; iter < MAX_ITER; ++iter){
+        size_t remaining = 0;
+        for(size_t i = 0; i < m; ++i){
+          double d0, d1;
+          digamma_trigamma(x[i], d0, d1);
+          double step = active[i] ? (d0 - target[i]) / d1 : 0;
+          x[i] -= step;
+          active[i] = active[i] && std::fabs(step) >= 1e-12 * x[i];
+          remaining += active[i];
+        }
+        if(remaining == 0)
+          break;
+      }
+      std::copy(x, x + m, out + first);
+    }
+  }
+
+  inline double inv_psi(double d){
+    double x;
+    inv_psi(&d, 1, &x);
     return x;
   }
 
   inline Vector inv_psi(const Vector &v){
-    return apply(v, inv_psi);
+    Vector result(v.size());
+    parallel_for(v.size(), 1 << 12, [&](size_t start, size_t stop){
+      inv_psi(v.data() + start, stop - start, result.data() + start);
+    });
+    return result;
   }
 
-  inline Matrix inv_psi(const Matrix  &m){
-    return apply(m, inv_psi);
+  inline Matrix inv_psi(const Matrix &m){
+    Matrix result(m.nrows(), m.ncols());
+    parallel_for(m.size(), 1 << 12, [&](size_t start, size_t stop){
+      inv_psi(m.data() + start, stop - start, result.data() + start);
+    });
+    return result;
   }
 
-  // KL Divergence Between Vectors
-  inline double kl_div(const Vector &x, const Vector &y) {
-    ASSERT_TRUE(x.size() == y.size(), "kl_div:: Size mismatch.");
-    double result = 0;
-    for (size_t i = 0; i < x.size(); ++i) {
-      if(x(i) > 0 && y(i) > 0){
-        result -= x(i) * (std::log(y(i)) - std::log(x(i))) - y(i) + x(i);
-      } else if(x(i) == 0 && y(i) >= 0){
-        result += y(i);
-      } else {
-        result += std::numeric_limits<double>::infinity();
-        break;
+  // ------- Tables at counts -------
+  //
+  // Count models evaluate gammaln(n + alpha) and psi(n + alpha) for small
+  // counts n and a fixed alpha over and over. SpecialTable stores both for
+  // n < max_size, in chunks that are computed on first use. Readers do not
+  // lock: a chunk pointer is published atomically once the chunk is
+  // filled, and only filling takes the mutex. Counts beyond max_size are
+  // computed directly.
+  class SpecialTable {
+    public:
+      explicit SpecialTable(double alpha_ = 0, size_t max_size = 1 << 24)
+          : alpha(alpha_), chunks((max_size + CHUNK_SIZE - 1) / CHUNK_SIZE) {
+        for(auto &chunk : chunks)
+          chunk.store(nullptr, std::memory_order_relaxed);
       }
+
+      SpecialTable(const SpecialTable &) = delete;
+      SpecialTable& operator=(const SpecialTable &) = delete;
+
+      ~SpecialTable() {
+        for(auto &chunk : chunks)
+          delete[] chunk.load(std::memory_order_relaxed);
+      }
+
+      double getAlpha() const {
+        return alpha;
+      }
+
+      // gammaln(n + alpha)
+      double gammaln(size_t n) const {
+        const double *chunk = get_chunk(n);
+        return chunk ? chunk[n % CHUNK_SIZE] : pml::gammaln(n + alpha);
+      }
+
+      // psi(n + alpha)
+      double psi(size_t n) const {
+        const double *chunk = get_chunk(n);
+        return chunk ? chunk[CHUNK_SIZE + n % CHUNK_SIZE]
+                     : digamma(n + alpha);
+      }
+
+    private:
+      const double *get_chunk(size_t n) const {
+        size_t c = n / CHUNK_SIZE;
+        if(c >= chunks.size())
+          return nullptr;
+        const double *chunk = chunks[c].load(std::memory_order_acquire);
+        return chunk ? chunk : fill_chunk(c);
+      }
+
+      // Chunk c holds gammaln and then psi of n + alpha for
+      // n = c * CHUNK_SIZE, ..., (c + 1) * CHUNK_SIZE - 1.
+      const double *fill_chunk(size_t c) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        const double *chunk = chunks[c].load(std::memory_order_relaxed);
+        if(chunk)
+          return chunk;
+        std::vector<double> x(CHUNK_SIZE);
+        for(size_t i = 0; i < CHUNK_SIZE; ++i)
+          x[i] = c * CHUNK_SIZE + i + alpha;
+        double *values = new double[2 * CHUNK_SIZE];
+        pml::gammaln(x.data(), CHUNK_SIZE, values);
+        digamma(x.data(), CHUNK_SIZE, values + CHUNK_SIZE);
+        chunks[c].store(values, std::memory_order_release);
+        return values;
+      }
+
+    public:
+      static const size_t CHUNK_SIZE = 1 << 12;
+
+    private:
+      double alpha;
+      mutable std::mutex mutex;
+      mutable std::vector<std::atomic<const double*>> chunks;
+  };
+
+  // ------- Standard normal quantile -------
+  // Acklam's rational approximation, refined by one Halley step on erfc
+  // to full double precision. Returns -inf at 0 and inf at 1.
+  inline double normal_quantile(double p){
+    static const double a[] = {-3.969683028665376e+01,  2.209460984245205e+02,
+                               -2.759285104469687e+02,  1.383577518672690e+02,
+                               -3.066479806614716e+01,  2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01,  1.615858368580409e+02,
+                               -1.556989798598866e+02,  6.680131188771972e+01,
+                               -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01,
+                               -2.400758277161838e+00, -2.549732539343734e+00,
+                                4.374664141464968e+00,  2.938163982698783e+00};
+    static const double d[] = { 7.784695709041462e-03,  3.224671290700398e-01,
+                                2.445134137142996e+00,  3.754408661907416e+00};
+    const double p_low = 0.02425;
+    if(p <= 0 || p >= 1){
+      if(p == 0) return -std::numeric_limits<double>::infinity();
+      if(p == 1) return std::numeric_limits<double>::infinity();
+      return std::numeric_limits<double>::quiet_NaN();
+    }
+    double x;
+    if(p < p_low || p > 1 - p_low){
+      double q = std::sqrt(-2 * std::log(p < p_low ? p : 1 - p));
+      x = (((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) /
+          ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1);
+      if(p > p_low)
+        x = -x;
+    } else {
+      double q = p - 0.5, r = q * q;
+      x = (((((a[0]*r + a[1])*r + a[2])*r + a[3])*r + a[4])*r + a[5])*q /
+          (((((b[0]*r + b[1])*r + b[2])*r + b[3])*r + b[4])*r + 1);
+    }
+    double e = 0.5 * std::erfc(-x / M_SQRT2) - p;
+    double u = e * std::sqrt(2 * M_PI) * std::exp(0.5 * x * x);
+    return x - u / (1 + 0.5 * x * u);
+  }
+
+  // ------- Divergences -------
+  //
+  // Divergences between non-negative vectors, e.g. histograms or
+  // probability distributions. kl_div is the generalized KL divergence
+  // sum x log(x/y) - x + y, which is the usual one for distributions.
+  // Each divergence is available between two Vectors, between two
+  // Matrices as a whole, between the matching columns (axis = 0) or rows
+  // (axis = 1) of two Matrices, and between every column of X and every
+  // column of Y (pairwise). Matrices are read in place, and the
+  // per-column results are summed in a fixed order.
+
+  // Implementation of the divergences below.
+  namespace detail {
+
+    // Pointwise terms. Negative inputs and terms that diverge give inf.
+    struct KLTerm {
+      double operator()(double x, double y) const {
+        if(x > 0 && y > 0)
+          return x * std::log(x / y) - x + y;
+        return (x == 0 && y >= 0) ? y : std::numeric_limits<double>::infinity();
+      }
+    };
+
+    struct SymmetricKLTerm {
+      double operator()(double x, double y) const {
+        if(x > 0 && y > 0)
+          return (x - y) * std::log(x / y);
+        return (x == 0 && y == 0) ? 0 : std::numeric_limits<double>::infinity();
+      }
+    };
+
+    struct JSTerm {
+      double operator()(double x, double y) const {
+        if(x < 0 || y < 0)
+          return std::numeric_limits<double>::infinity();
+        double m = 0.5 * (x + y), result = 0;
+        if(x > 0)
+          result += 0.5 * x * std::log(x / m);
+        if(y > 0)
+          result += 0.5 * y * std::log(y / m);
+        return result;
+      }
+    };
+
+    // Squared Hellinger distance term.
+    struct HellingerTerm {
+      double operator()(double x, double y) const {
+        if(x < 0 || y < 0)
+          return std::numeric_limits<double>::infinity();
+        double d = std::sqrt(x) - std::sqrt(y);
+        return 0.5 * d * d;
+      }
+    };
+
+    // Sum of term(x[i * stride], y[i * stride]) for i < n.
+    template <typename Term>
+    inline double divergence_sum(const double *x, const double *y, size_t n,
+                                 size_t stride, Term term) {
+      double result = 0;
+      for(size_t i = 0; i < n * stride; i += stride)
+        result += term(x[i], y[i]);
+      return result;
+    }
+
+    template <typename Term>
+    inline double divergence_sum(const Vector &x, const Vector &y, Term term) {
+      ASSERT_TRUE(x.size() == y.size(), "divergence:: Size mismatch.");
+      return divergence_sum(x.data(), y.data(), x.size(), 1, term);
+    }
+
+    // Sums along axis 0 (one value per column) or axis 1 (one per row).
+    template <typename Term>
+    inline Vector divergence_sum(const Matrix &x, const Matrix &y, int axis,
+                                 Term term) {
+      ASSERT_TRUE(x.shape() == y.shape(), "divergence:: Size mismatch.");
+      ASSERT_TRUE(axis == 0 || axis == 1, "divergence:: Axis out of bounds.");
+      size_t nrows = x.nrows();
+      size_t n = axis == 0 ? x.ncols() : nrows;
+      Vector result(n);
+      parallel_for(n, 16, [&](size_t start, size_t stop){
+        for(size_t i = start; i < stop; ++i){
+          if(axis == 0)
+            result[i] = divergence_sum(x.data() + i * nrows,
+                                       y.data() + i * nrows, nrows, 1, term);
+          else
+            result[i] = divergence_sum(x.data() + i, y.data() + i,
+                                       x.ncols(), nrows, term);
+        }
+      });
+      return result;
+    }
+
+    template <typename Term>
+    inline double divergence_sum(const Matrix &x, const Matrix &y, Term term) {
+      return sum(divergence_sum(x, y, 0, term));
+    }
+
+    // Pairwise sums between the columns of X and Y, computed directly.
+    template <typename Term>
+    inline Matrix divergence_pairwise(const Matrix &X, const Matrix &Y,
+                                      Term term) {
+      ASSERT_TRUE(X.nrows() == Y.nrows(), "divergence:: Size mismatch.");
+      size_t d = X.nrows();
+      Matrix result(X.ncols(), Y.ncols());
+      parallel_for(Y.ncols(), 1, [&](size_t start, size_t stop){
+        for(size_t j = start; j < stop; ++j)
+          for(size_t i = 0; i < X.ncols(); ++i)
+            result(i, j) = divergence_sum(X.data() + i * d, Y.data() + j * d,
+                                          d, 1, term);
+      });
+      return result;
+    }
+
+    // Elementwise f(x), with f applied in parallel.
+    template <typename Func>
+    inline Matrix divergence_map(const Matrix &x, Func f) {
+      Matrix result(x.nrows(), x.ncols());
+      parallel_for(x.size(), 1 << 14, [&](size_t start, size_t stop){
+        for(size_t i = start; i < stop; ++i)
+          result[i] = f(x[i]);
+      });
+      return result;
+    }
+
+    // Sum of f(x) over each column.
+    template <typename Func>
+    inline Vector divergence_column_sums(const Matrix &x, Func f) {
+      Vector result(x.ncols());
+      parallel_for(x.ncols(), 16, [&](size_t start, size_t stop){
+        for(size_t j = start; j < stop; ++j){
+          double total = 0;
+          for(size_t i = 0; i < x.nrows(); ++i)
+            total += f(x(i, j));
+          result[j] = total;
+        }
+      });
+      return result;
+    }
+
+    // Sets result(i, j) to inf wherever some row has x > 0 and y == 0 in
+    // columns i of X and j of Y, or also x == 0 and y > 0 if symmetric,
+    // using products of indicator matrices.
+    inline void divergence_support(const Matrix &X, const Matrix &Y,
+                                   Matrix &result, bool symmetric = false) {
+      auto zero = [](double x){ return x == 0 ? 1.0 : 0.0; };
+      auto positive = [](double x){ return x > 0 ? 1.0 : 0.0; };
+      Matrix y_zero = divergence_map(Y, zero);
+      Matrix x_zero = symmetric ? divergence_map(X, zero) : Matrix();
+      if(sum(y_zero) == 0 && (!symmetric || sum(x_zero) == 0))
+        return;
+      Matrix overlap = dot(divergence_map(X, positive), y_zero, true);
+      if(symmetric)
+        overlap += dot(x_zero, divergence_map(Y, positive), true);
+      for(size_t i = 0; i < result.size(); ++i)
+        if(overlap[i] > 0)
+          result[i] = std::numeric_limits<double>::infinity();
+    }
+
+    // Sets rows (columns) of result to inf for columns of X (Y) that have
+    // negative entries.
+    inline void divergence_negative(const Matrix &X, const Matrix &Y,
+                                    Matrix &result) {
+      const double inf = std::numeric_limits<double>::infinity();
+      auto negative = [](double x){ return x < 0; };
+      Vector x_negative = divergence_column_sums(X, negative);
+      Vector y_negative = divergence_column_sums(Y, negative);
+      for(size_t j = 0; j < result.ncols(); ++j)
+        for(size_t i = 0; i < result.nrows(); ++i)
+          if(x_negative[i] > 0 || y_negative[j] > 0)
+            result(i, j) = inf;
+    }
+
+    // x log x with 0 log 0 = 0, and log x with log 0 replaced by 0; the
+    // zeros are handled by divergence_support.
+    inline double xlogx(double x) {
+      return x > 0 ? x * std::log(x) : 0;
+    }
+
+    inline double log_or_zero(double x) {
+      return x > 0 ? std::log(x) : 0;
     }
+
+  } // namespace detail
+
+  inline double kl_div(const Vector &x, const Vector &y) {
+    return detail::divergence_sum(x, y, detail::KLTerm());
+  }
+
+  inline double kl_div(const Matrix &x, const Matrix &y) {
+    return detail::divergence_sum(x, y, detail::KLTerm());
+  }
+
+  inline Vector kl_div(const Matrix &x, const Matrix &y, int axis) {
+    return detail::divergence_sum(x, y, axis, detail::KLTerm());
+  }
+
+  // KL divergence from every column of X to every column of Y, as an
+  // X.ncols() x Y.ncols() Matrix. Expanding the log turns the cross terms
+  // into the product X' log(Y), which is done with BLAS.
+  inline Matrix kl_div_pairwise(const Matrix &X, const Matrix &Y) {
+    ASSERT_TRUE(X.nrows() == Y.nrows(), "kl_div_pairwise:: Size mismatch.");
+    Vector entropy = detail::divergence_column_sums(X, detail::xlogx);
+    Vector x_sum = detail::divergence_column_sums(X, [](double x){ return x; });
+    Vector y_sum = detail::divergence_column_sums(Y, [](double y){ return y; });
+    Matrix log_y = detail::divergence_map(Y, detail::log_or_zero);
+    Matrix result = dot(X, log_y, true);
+    for(size_t j = 0; j < result.ncols(); ++j)
+      for(size_t i = 0; i < result.nrows(); ++i)
+        result(i, j) = std::max(0.0, entropy[i] - result(i, j) - x_sum[i] +
+                                     y_sum[j]);
+    detail::divergence_support(X, Y, result);
+    detail::divergence_negative(X, Y, result);
     return result;
   }
 
-  double kl_div(const Matrix &x, const Matrix &y){
-    return kl_div(flatten(x), flatten(y));
+  // Symmetric KL divergence, kl_div(x, y) + kl_div(y, x).
+  inline double symmetric_kl_div(const Vector &x, const Vector &y) {
+    return detail::divergence_sum(x, y, detail::SymmetricKLTerm());
+  }
+
+  inline double symmetric_kl_div(const Matrix &x, const Matrix &y) {
+    return detail::divergence_sum(x, y, detail::SymmetricKLTerm());
+  }
+
+  inline Vector symmetric_kl_div(const Matrix &x, const Matrix &y, int axis) {
+    return detail::divergence_sum(x, y, axis, detail::SymmetricKLTerm());
+  }
+
+  inline Matrix symmetric_kl_div_pairwise(const Matrix &X, const Matrix &Y) {
+    ASSERT_TRUE(X.nrows() == Y.nrows(),
+                "symmetric_kl_div_pairwise:: Size mismatch.");
+    Vector x_entropy = detail::divergence_column_sums(X, detail::xlogx);
+    Vector y_entropy = detail::divergence_column_sums(Y, detail::xlogx);
+    Matrix log_x = detail::divergence_map(X, detail::log_or_zero);
+    Matrix log_y = detail::divergence_map(Y, detail::log_or_zero);
+    Matrix cross = dot(X, log_y, true);
+    Matrix result = dot(log_x, Y, true);
+    for(size_t j = 0; j < result.ncols(); ++j)
+      for(size_t i = 0; i < result.nrows(); ++i)
+        result(i, j) = std::max(0.0, x_entropy[i] + y_entropy[j] -
+                                     cross(i, j) - result(i, j));
+    detail::divergence_support(X, Y, result, true);
+    detail::divergence_negative(X, Y, result);
+    return result;
+  }
+
+  // Jensen-Shannon divergence, in nats.
+  inline double js_div(const Vector &x, const Vector &y) {
+    return detail::divergence_sum(x, y, detail::JSTerm());
+  }
+
+  inline double js_div(const Matrix &x, const Matrix &y) {
+    return detail::divergence_sum(x, y, detail::JSTerm());
+  }
+
+  inline Vector js_div(const Matrix &x, const Matrix &y, int axis) {
+    return detail::divergence_sum(x, y, axis, detail::JSTerm());
+  }
+
+  // The log of the mixture does not factor, so the pairs are computed
+  // directly, in parallel over the columns of Y.
+  inline Matrix js_div_pairwise(const Matrix &X, const Matrix &Y) {
+    return detail::divergence_pairwise(X, Y, detail::JSTerm());
+  }
+
+  // Hellinger distance, sqrt(sum (sqrt(x) - sqrt(y))^2 / 2).
+  inline double hellinger(const Vector &x, const Vector &y) {
+    return std::sqrt(detail::divergence_sum(x, y, detail::HellingerTerm()));
+  }
+
+  inline double hellinger(const Matrix &x, const Matrix &y) {
+    return std::sqrt(detail::divergence_sum(x, y, detail::HellingerTerm()));
+  }
+
+  inline Vector hellinger(const Matrix &x, const Matrix &y, int axis) {
+    Vector result = detail::divergence_sum(x, y, axis, detail::HellingerTerm());
+    for(auto &d : result)
+      d = std::sqrt(d);
+    return result;
+  }
+
+  // The squared distance is (sum x + sum y) / 2 - sqrt(X)' sqrt(Y).
+  inline Matrix hellinger_pairwise(const Matrix &X, const Matrix &Y) {
+    ASSERT_TRUE(X.nrows() == Y.nrows(), "hellinger_pairwise:: Size mismatch.");
+    auto root = [](double x){ return x > 0 ? std::sqrt(x) : 0; };
+    Vector x_sum = detail::divergence_column_sums(X, [](double x){ return x; });
+    Vector y_sum = detail::divergence_column_sums(Y, [](double y){ return y; });
+    Matrix result = dot(detail::divergence_map(X, root),
+                        detail::divergence_map(Y, root), true);
+    for(size_t j = 0; j < result.ncols(); ++j)
+      for(size_t i = 0; i < result.nrows(); ++i)
+        result(i, j) = std::sqrt(std::max(0.0, 0.5 * (x_sum[i] + y_sum[j]) -
+                                               result(i, j)));
+    detail::divergence_negative(X, Y, result);
+    return result;
   }
 
 } // namespace pml
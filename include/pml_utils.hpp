@@ -2,10 +2,32 @@
 #define PML_UTILS_H_
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <fstream>
-#include <regex>
-#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef PML_WITH_ZLIB
+#define PML_WITH_ZLIB 1
+#endif
+
+#if PML_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include "pml_parallel.hpp"
 
 namespace pml {
 
@@ -29,14 +51,55 @@ namespace pml {
     return true;
   }
 
+  // Matches strings against a fixed set of suffixes, e.g. file extensions.
+  // An empty set of suffixes matches every string. A table of the suffixes'
+  // last characters rejects most non-matching strings with a single lookup.
+  class SuffixMatcher {
+    public:
+      explicit SuffixMatcher(const std::vector<std::string> &suffixes_)
+          : suffixes(suffixes_), last_chars(256, false),
+            match_all(suffixes_.empty()) {
+        for (auto &suffix : suffixes) {
+          if (suffix.empty()) {
+            match_all = true;
+          } else {
+            last_chars[static_cast<unsigned char>(suffix.back())] = true;
+          }
+        }
+      }
+
+      bool match(const char *str, size_t length) const {
+        if (match_all)
+          return true;
+        if (length == 0 ||
+            !last_chars[static_cast<unsigned char>(str[length-1])])
+          return false;
+        for (auto &suffix : suffixes) {
+          if (suffix.size() <= length &&
+              memcmp(str + length - suffix.size(), suffix.data(),
+                     suffix.size()) == 0)
+            return true;
+        }
+        return false;
+      }
+
+      bool match(const std::string &str) const {
+        return match(str.data(), str.size());
+      }
+
+    private:
+      std::vector<std::string> suffixes;
+      std::vector<bool> last_chars;
+      bool match_all;
+  };
+
   // Check wheter the string ends with the given extension.
   inline bool ends_with(const std::string &str,
                         const std::vector<std::string> &extensions) {
-    for(auto &ext : extensions){
-      std::regex e("(.*)" + ext);
-      if (std::regex_match(str, e)){
+    for (auto &ext : extensions) {
+      if (ext.size() <= str.size() &&
+          str.compare(str.size() - ext.size(), ext.size(), ext) == 0)
         return true;
-      }
     }
     return false;
   }
@@ -57,7 +120,6 @@ namespace pml {
   }
 
   // Returns a vector of strings containing file names in the directory dirname.
-  // The files must end with one of the extensions in the extensions vector.
   // If 'fullpath' is set, the file paths are absolute, starting from '/'
   // Returned files are guaranteed to be in the alphabetical order.
   inline std::vector <std::string> ls(std::string dirname, bool fullpath=false){
@@ -79,32 +141,208 @@ namespace pml {
     return files;
   }
 
-  // Compresses 'src_file' to 'dst_file'.
+  // Returns the regular files in the directory dirname that end with one of
+  // the extensions. An empty extension list matches every file.
+  // If 'recursive' is set, subdirectories are listed too, by several threads
+  // in parallel; their files are prefixed with their path relative to
+  // dirname. If 'fullpath' is set, the paths start with dirname.
+  // The directory entry types are used to skip stat() calls whenever the
+  // file system provides them. Symbolic links to directories are not
+  // followed. Returned files are in alphabetical order.
+  inline std::vector<std::string> find_files(
+      const std::string &dirname, const std::vector<std::string> &extensions,
+      bool fullpath = false, bool recursive = false) {
+    SuffixMatcher matcher(extensions);
+    std::vector<std::string> files;
+    std::vector<std::string> pending = {""};   // relative paths of directories
+    size_t busy = 0;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    // Lists one directory, returning its matching files and subdirectories.
+    auto list = [&](const std::string &relative,
+                    std::vector<std::string> &found,
+                    std::vector<std::string> &subdirs) {
+      std::string path = relative.empty() ? dirname
+                                          : path_join({dirname, relative});
+      DIR *dir = opendir(path.c_str());
+      if (!dir)
+        return;
+      struct dirent *dp;
+      while ((dp = readdir(dir)) != NULL) {
+        const char *name = dp->d_name;
+        if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+          continue;
+        unsigned char type = dp->d_type;
+        if (type == DT_UNKNOWN || type == DT_LNK) {
+          // Symbolic links to files are listed, but links to directories
+          // are not followed, so that cycles cannot make the walk endless.
+          std::string full = path_join({path, name});
+          struct stat st;
+          if (lstat(full.c_str(), &st) != 0)
+            continue;
+          bool link = S_ISLNK(st.st_mode);
+          if (link && stat(full.c_str(), &st) != 0)
+            continue;
+          type = S_ISREG(st.st_mode) ? DT_REG :
+                 S_ISDIR(st.st_mode) && !link ? DT_DIR : DT_UNKNOWN;
+        }
+        std::string entry = relative.empty() ? std::string(name)
+                                             : path_join({relative, name});
+        if (type == DT_DIR) {
+          if (recursive)
+            subdirs.push_back(entry);
+        } else if (type == DT_REG && matcher.match(name, strlen(name))) {
+          found.push_back(entry);
+        }
+      }
+      closedir(dir);
+    };
+
+    // Workers take directories from 'pending' until it is empty and no
+    // other worker can add more.
+    auto work = [&]() {
+      std::vector<std::string> found, subdirs;
+      std::unique_lock<std::mutex> lock(mutex);
+      while (true) {
+        cv.wait(lock, [&]{ return !pending.empty() || busy == 0; });
+        if (pending.empty())
+          break;
+        std::string relative = std::move(pending.back());
+        pending.pop_back();
+        ++busy;
+        lock.unlock();
+        list(relative, found, subdirs);
+        lock.lock();
+        --busy;
+        pending.insert(pending.end(), subdirs.begin(), subdirs.end());
+        subdirs.clear();
+        cv.notify_all();
+      }
+      files.insert(files.end(), found.begin(), found.end());
+    };
+
+    std::vector<std::thread> workers;
+    size_t num_workers = recursive ? get_num_threads() : 1;
+    for (size_t i = 1; i < num_workers; ++i)
+      workers.emplace_back(work);
+    work();
+    for (auto &worker : workers)
+      worker.join();
+
+    if (fullpath) {
+      for (auto &file : files)
+        file = path_join({dirname, file});
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+  }
+
+  // Read-only memory mapping of a whole file. The mapping is released
+  // when the object is destroyed.
+  class MemoryMap {
+    public:
+      explicit MemoryMap(const std::string &filename)
+          : data_(nullptr), size_(0) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+          return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+          void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+          if (addr != MAP_FAILED) {
+            data_ = static_cast<const char*>(addr);
+            size_ = st.st_size;
+          }
+        }
+        close(fd);
+      }
+
+      MemoryMap(const MemoryMap &) = delete;
+      MemoryMap& operator=(const MemoryMap &) = delete;
+
+      ~MemoryMap() {
+        if (data_)
+          munmap(const_cast<char*>(data_), size_);
+      }
+
+      bool is_open() const {
+        return data_ != nullptr;
+      }
+
+      const char *data() const {
+        return data_;
+      }
+
+      size_t size() const {
+        return size_;
+      }
+
+    private:
+      const char *data_;
+      size_t size_;
+  };
+
+#if PML_WITH_ZLIB
+  // Compresses 'src_file' to 'dst_file' in gzip format.
   inline bool zip(const std::string &src_file, const std::string &dst_file) {
-    std::string cmd = "gzip -c " + src_file + " > " + dst_file;
-    return !system(cmd.c_str());
+    FILE *src = fopen(src_file.c_str(), "rb");
+    if (!src)
+      return false;
+    gzFile dst = gzopen(dst_file.c_str(), "wb");
+    if (!dst) {
+      fclose(src);
+      return false;
+    }
+    std::vector<char> buffer(1 << 20);
+    bool ok = true;
+    size_t n;
+    while (ok && (n = fread(buffer.data(), 1, buffer.size(), src)) > 0)
+      ok = gzwrite(dst, buffer.data(), n) == int(n);
+    ok = !ferror(src) && ok;
+    fclose(src);
+    return (gzclose(dst) == Z_OK) && ok;
   }
 
-  // Decompresses 'src_file' to 'dst_file'.
+  // Decompresses the gzip file 'src_file' to 'dst_file'.
   inline bool unzip(const std::string &src_file,
                     const std::string &dst_file) {
-    std::string cmd = "gunzip -c " + src_file + " > " + dst_file;
-    return !system(cmd.c_str());
+    gzFile src = gzopen(src_file.c_str(), "rb");
+    if (!src)
+      return false;
+    FILE *dst = fopen(dst_file.c_str(), "wb");
+    if (!dst) {
+      gzclose(src);
+      return false;
+    }
+    std::vector<char> buffer(1 << 20);
+    bool ok = true;
+    int n;
+    while (ok && (n = gzread(src, buffer.data(), buffer.size())) > 0)
+      ok = fwrite(buffer.data(), 1, n, dst) == size_t(n);
+    ok = ok && n == 0;
+    gzclose(src);
+    return (fclose(dst) == 0) && ok;
   }
+#endif
 
   // Removes file src_file from the disk.
   inline bool rm(const std::string &src_file) {
-    std::string cmd = "rm " + src_file;
-    return !system(cmd.c_str());
+    return unlink(src_file.c_str()) == 0;
   }
 
-  // Creates given directory
+  // Creates the given directory and its missing parents, like mkdir -p.
   inline bool find_or_create(const std::string &dir_name) {
-    if (!dir_exists(dir_name)) {
-      std::string cmd = "mkdir " + dir_name;
-      return !system(cmd.c_str());
+    if (dir_exists(dir_name))
+      return true;
+    for (size_t pos = dir_name.find('/', 1); ; pos = dir_name.find('/', pos + 1)) {
+      std::string parent = dir_name.substr(0, pos);
+      if (mkdir(parent.c_str(), 0777) != 0 && errno != EEXIST)
+        return false;
+      if (pos == std::string::npos)
+        break;
     }
-    return true;
+    return dir_exists(dir_name);
   }
 
 }
@@ -11,9 +11,12 @@
 #include <gsl/gsl_sf_psi.h>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <numeric>
 #include <vector>
 
+#include "pml_compress.hpp"
+
 #define DEFAULT_PRECISION 6
 
 namespace pml {
@@ -38,6 +41,27 @@ namespace pml {
     return fabs(a - b) < 1e-6;
   }
 
+  // Safe log(exp(x) + exp(y))
+  inline double logAddExp(double x, double y) {
+    if (x < y)
+      std::swap(x, y);
+    if (y == -std::numeric_limits<double>::infinity() ||
+        x == std::numeric_limits<double>::infinity())
+      return x;
+    return x + std::log1p(std::exp(y - x));
+  }
+
+  // In place logAddExp of arrays, x[i] = logAddExp(x[i], y[i]).
+  inline void logAddExp(double *x, const double *y, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      double hi = std::max(x[i], y[i]), lo = std::min(x[i], y[i]);
+      double sum = hi + std::log1p(std::exp(lo - hi));
+      bool skip = lo == -std::numeric_limits<double>::infinity() ||
+                  hi == std::numeric_limits<double>::infinity();
+      x[i] = skip ? hi : sum;
+    }
+  }
+
   class Vector {
     public:
       // Empty Vector
@@ -476,16 +500,26 @@ namespace pml {
         return in;
       }
 
-      void save(const std::string &filename){
+      // Saves the Vector in binary format. If compression_level is in [1, 9],
+      // the data is zlib compressed in blocks (see pml_compress.hpp) and
+      // optionally byte shuffled first.
+      // Returns false if the file could not be written.
+      bool save(const std::string &filename, int compression_level = 0,
+                bool shuffle = true) const {
+        if (compression_level > 0)
+          return pmlz_save(filename, {size()}, data(), compression_level,
+                           shuffle);
         std::ofstream ofs(filename, std::ios::binary | std::ios::out);
-        if (ofs.is_open()) {
-          double dim = 1;
-          double length = size();
-          ofs.write(reinterpret_cast<char*>(&dim), sizeof(double));
-          ofs.write(reinterpret_cast<char*>(&length), sizeof(double));
-          ofs.write(reinterpret_cast<char*>(data()), sizeof(double)*length);
-          ofs.close();
-        }
+        if (!ofs.is_open())
+          return false;
+        double dim = 1;
+        double length = size();
+        ofs.write(reinterpret_cast<char*>(&dim), sizeof(double));
+        ofs.write(reinterpret_cast<char*>(&length), sizeof(double));
+        ofs.write(reinterpret_cast<const char*>(data()),
+                  sizeof(double)*length);
+        ofs.close();
+        return ofs.good();
       }
 
       void saveTxt(const std::string &filename,
@@ -502,17 +536,28 @@ namespace pml {
         }
       }
 
+      // Loads a Vector saved with save(), compressed or not.
       static Vector load(const std::string &filename){
         Vector result;
-        std::ifstream ifs(filename, std::ios::binary | std::ios::in);
-        if (ifs.is_open()) {
-          double dim, size;
-          ifs.read(reinterpret_cast<char*>(&dim), sizeof(double));
-          ASSERT_TRUE(dim == 1, "Vector::load:: Dimension mismatch.");
-          ifs.read(reinterpret_cast<char*>(&size), sizeof(double));
-          result.resize(size);
-          ifs.read(reinterpret_cast<char*>(result.data()), sizeof(double)*size);
-          ifs.close();
+        PmlzReader reader(filename);
+        if (reader.is_open()) {
+          ASSERT_TRUE(reader.dims().size() == 1,
+                      "Vector::load:: Dimension mismatch.");
+          result.resize(reader.size());
+          ASSERT_TRUE(reader.read(0, reader.size(), result.data()),
+                      "Vector::load:: Corrupted file.");
+        } else {
+          std::ifstream ifs(filename, std::ios::binary | std::ios::in);
+          if (ifs.is_open()) {
+            double dim, size;
+            ifs.read(reinterpret_cast<char*>(&dim), sizeof(double));
+            ASSERT_TRUE(dim == 1, "Vector::load:: Dimension mismatch.");
+            ifs.read(reinterpret_cast<char*>(&size), sizeof(double));
+            result.resize(size);
+            ifs.read(reinterpret_cast<char*>(result.data()),
+                     sizeof(double)*size);
+            ifs.close();
+          }
         }
         return result;
       }
@@ -572,6 +617,15 @@ namespace pml {
         normalize();
       }
 
+      // Accumulates other in log space, this = log(exp(this) + exp(other)).
+      void logAddExp(const Vector &other){
+        ASSERT_TRUE(size() == other.size(),
+                    "Vector::logAddExp:: Size mismatch.");
+        parallel_for(size(), 1 << 14, [&](size_t start, size_t stop){
+          pml::logAddExp(data() + start, other.data() + start, stop - start);
+        });
+      }
+
     public:
       std::vector<double> data_;
   };
@@ -701,6 +755,13 @@ namespace pml {
     return result;
   }
 
+  // Safe log(exp(x) + exp(y)), elementwise.
+  inline Vector logAddExp(const Vector &x, const Vector &y) {
+    Vector result(x);
+    result.logAddExp(y);
+    return result;
+  }
+
   // Safe log(sum(exp(x)))
   inline double logSumExp(const Vector &x) {
     double result = 0;
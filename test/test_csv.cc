@@ -0,0 +1,77 @@
+#include <cassert>
+
+#include "pml_csv.hpp"
+
+using namespace pml;
+
+void test_csv(){
+  std::cout << "test_csv...\n";
+
+  std::ofstream ofs("/tmp/test_csv.csv");
+  ofs << "a,b,c\r\n"
+      << "1,2,3\r\n"
+      << "4,,6\r\n"
+      << "\n"
+      << "7,NA,\"9\"\r\n"
+      << "10,11.5,1e3";
+  ofs.close();
+
+  Matrix m = loadCsv("/tmp/test_csv.csv", CsvOptions(',', true));
+  assert(m.nrows() == 4 && m.ncols() == 3);
+  assert(m(0,0) == 1 && m(0,1) == 2 && m(0,2) == 3);
+  assert(std::isnan(m(1,1)) && std::isnan(m(2,1)));
+  assert(m(2,2) == 9);
+  assert(m(3,1) == 11.5 && m(3,2) == 1000);
+
+  // Column selection
+  CsvOptions options(',', true);
+  options.columns = {2, 0};
+  Matrix m2 = loadCsv("/tmp/test_csv.csv", options);
+  assert(m2.equals(Matrix(4, 2, {3, 6, 9, 1000, 1, 4, 7, 10})));
+
+  // Repeated columns
+  options.columns = {0, 2, 0};
+  Matrix m4 = loadCsv("/tmp/test_csv.csv", options);
+  assert(m4.equals(Matrix(4, 3, {1, 4, 7, 10, 3, 6, 9, 1000, 1, 4, 7, 10})));
+
+  options.columns.clear();
+  options.skip = {1};
+  Matrix m3 = loadCsv("/tmp/test_csv.csv", options);
+  assert(m3.equals(Matrix(4, 2, {1, 4, 7, 10, 3, 6, 9, 1000})));
+
+  // Fields longer than the local parse buffer
+  std::string digits = "0." + std::string(80, '0') + "25";
+  std::string field = digits + std::string(30, ' ');
+  assert(csv_parse_field(field.data(), field.data() + field.size()) == 25e-82);
+  field = "1" + std::string(70, 'x');
+  assert(std::isnan(csv_parse_field(field.data(), field.data() + field.size())));
+
+  std::cout << "OK.\n";
+}
+
+void test_csv_chunks(){
+  std::cout << "test_csv_chunks...\n";
+
+  // Large enough to be split into several chunks
+  Matrix m(200000, 3);
+  std::ofstream ofs("/tmp/test_csv.tsv");
+  for(size_t i = 0; i < m.nrows(); ++i){
+    m(i, 0) = i;
+    m(i, 1) = i % 7;
+    m(i, 2) = -0.5 * i;
+    ofs << m(i, 0) << "\t" << m(i, 1) << "\t" << m(i, 2) << "\n";
+  }
+  ofs.close();
+
+  set_num_threads(4);
+  Matrix m2 = loadCsv("/tmp/test_csv.tsv", CsvOptions('\t'));
+  assert(m.equals(m2));
+
+  std::cout << "OK.\n";
+}
+
+int main(){
+  test_csv();
+  test_csv_chunks();
+  return 0;
+}
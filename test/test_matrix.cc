@@ -112,6 +112,44 @@ void test_load_save(){
   Matrix m3 = Matrix::loadTxt("/tmp/test_matrix.txt");
   assert(m.equals(m3));
 
+  // Save and load compressed
+  m.save("/tmp/test_matrix.pmlz", 1);
+  Matrix m4 = Matrix::load("/tmp/test_matrix.pmlz");
+  assert(m.equals(m4));
+
+  // Load a subset of columns
+  Matrix m5 = Matrix::loadColumns("/tmp/test_matrix.pml", Range(1, 4, 2));
+  assert(m5.equals(Matrix(3, 2, {3, 4, 5, 9, 10, 11})));
+  Matrix m6 = Matrix::loadColumns("/tmp/test_matrix.pmlz", Range(1, 4, 2));
+  assert(m5.equals(m6));
+
+  // Random access into a file with many small blocks
+  Matrix big(100, 50);
+  for(size_t i = 0; i < big.size(); ++i)
+    big[i] = std::sin(i);
+  pmlz_save("/tmp/test_matrix.pmlz", {big.nrows(), big.ncols()},
+            big.data(), 1, true, 333);
+  assert(big.equals(Matrix::load("/tmp/test_matrix.pmlz")));
+  Matrix cols = Matrix::loadColumns("/tmp/test_matrix.pmlz", Range(7, 40, 5));
+  for(size_t j = 0; j < cols.ncols(); ++j)
+    assert(cols.getColumn(j).equals(big.getColumn(7 + 5*j)));
+  // Consecutive columns share blocks
+  cols = Matrix::loadColumns("/tmp/test_matrix.pmlz", Range(0, 50));
+  assert(cols.equals(big));
+  assert(Matrix::loadColumns("/tmp/test_matrix.pmlz", Range(3, 3)).empty());
+  // Uncompressed files read the same columns
+  big.save("/tmp/test_matrix.pml");
+  cols = Matrix::loadColumns("/tmp/test_matrix.pml", Range(7, 40, 5));
+  assert(cols.nrows() == 100 && cols.ncols() == 7);
+  for(size_t j = 0; j < cols.ncols(); ++j)
+    assert(cols.getColumn(j).equals(big.getColumn(7 + 5*j)));
+  assert(Matrix::loadColumns("/tmp/test_matrix.pml", Range(3, 3)).empty());
+
+  // Unwritable files are reported
+  assert(m.save("/tmp/test_matrix.pmlz", 1));
+  assert(!m.save("/nonexistent/test_matrix.pml"));
+  assert(!m.save("/nonexistent/test_matrix.pmlz", 1));
+
   std::cout << "OK\n";
 }
 
@@ -225,6 +263,68 @@ void test_matrix_algebra(){
   std::cout << "OK\n";
 }
 
+// log(sum(exp(A(i, :) + B(:, j)))) computed directly
+double log_dot_entry(const Matrix &A, const Matrix &B, size_t i, size_t j){
+  Vector terms(A.ncols());
+  for(size_t k = 0; k < A.ncols(); ++k)
+    terms[k] = A(i, k) + B(k, j);
+  return logSumExp(terms);
+}
+
+void test_log_algebra(){
+  std::cout << "test_log_algebra...\n";
+
+  const double inf = std::numeric_limits<double>::infinity();
+
+  // logAddExp
+  assert(fequal(logAddExp(std::log(2), std::log(3)), std::log(5)));
+  assert(fequal(logAddExp(-1000, -1000), -1000 + std::log(2)));
+  assert(logAddExp(-inf, 3) == 3 && logAddExp(-inf, -inf) == -inf);
+  Vector acc = {0, -inf, 1000};
+  acc.logAddExp(Vector({0, 5, -inf}));
+  assert(acc.equals(Vector({std::log(2), 5, 1000})));
+  Matrix macc(2, 1, {-800, 0});
+  assert(logAddExp(macc, macc).equals(Matrix(2, 1, {std::log(2) - 800,
+                                                    std::log(2)})));
+
+  // Agrees with the plain product on moderate values
+  Matrix A(3, 2, {0.1, 0.2, 0.3, 0.4, 0.5, 0.6});
+  Matrix B(2, 2, {1, 2, 3, 4});
+  assert(logDot(A, B).equals(log(dot(exp(A), exp(B)))));
+  Vector v = {-1, 2};
+  assert(logDot(A, v).equals(log(dot(exp(A), exp(v)))));
+  assert(logDot(A, Vector({1, 2, 3}), true).equals(
+      log(dot(exp(A), exp(Vector({1, 2, 3})), true))));
+
+  // Large magnitudes and maxima at different k, over several blocks
+  Matrix C(4, 600), D(600, 3);
+  for(size_t i = 0; i < C.size(); ++i)
+    C[i] = -1000 + std::fmod(i * 37.0, 900);
+  for(size_t i = 0; i < D.size(); ++i)
+    D[i] = 500 - std::fmod(i * 53.0, 1100);
+  C(0, 0) = 0;  C(0, 599) = -800;
+  D(0, 0) = -800; D(599, 0) = 0;
+  C(1, 5) = -inf;
+  Matrix E = logDot(C, D);
+  for(size_t i = 0; i < E.nrows(); ++i)
+    for(size_t j = 0; j < E.ncols(); ++j)
+      assert(std::fabs(E(i, j) - log_dot_entry(C, D, i, j)) < 1e-10);
+
+  // The transposed product reads C in place
+  Vector x = D.getColumn(0);
+  Vector y = logDot(transpose(C), x, true);
+  for(size_t i = 0; i < y.size(); ++i)
+    assert(std::fabs(y[i] - log_dot_entry(C, D, i, 0)) < 1e-10);
+
+  // Rows of zeros stay zero
+  Matrix F(2, 2, {-inf, 0, -inf, 0});
+  Matrix G = logDot(F, Matrix(2, 2, {1, 2, 3, 4}));
+  assert(G(0, 0) == -inf && G(0, 1) == -inf);
+  assert(fequal(G(1, 0), std::log(std::exp(1) + std::exp(2))));
+
+  std::cout << "OK\n";
+}
+
 void test_matrix_append(){
 
   std::cout << "test_matrix_append...\n";
@@ -269,6 +369,7 @@ int main(){
   test_matrix_functions();
   test_matrix_algebra();
   test_matrix_append();
+  test_log_algebra();
   test_load_save();
   return 0;
 }
@@ -0,0 +1,111 @@
+#include <cassert>
+
+#include "pml_numpy.hpp"
+
+using namespace pml;
+
+void test_npy(){
+  std::cout << "test_npy...\n";
+
+  Matrix m(3, 4, {0,1,2,3,4,5,6,7,8,9,10,11});
+  assert(saveNpy("/tmp/test_numpy.npy", m));
+  Matrix m2 = loadNpy("/tmp/test_numpy.npy");
+  assert(m.equals(m2));
+
+  // Header is padded to 64 bytes
+  NpyHeader header;
+  std::ifstream ifs("/tmp/test_numpy.npy", std::ios::binary);
+  char buffer[128];
+  ifs.read(buffer, sizeof(buffer));
+  assert(npy_parse_header(buffer, sizeof(buffer), header));
+  assert(header.descr == "<f8");
+  assert(header.fortran_order);
+  assert(header.shape == std::vector<size_t>({3, 4}));
+  assert(header.data_offset % 64 == 0);
+
+  // Vectors are 1-D arrays
+  Vector v({1, 2, 3, 4, 5});
+  assert(saveNpy("/tmp/test_numpy.npy", v));
+  Matrix m3 = loadNpy("/tmp/test_numpy.npy");
+  assert(m3.nrows() == 5 && m3.ncols() == 1);
+  assert(flatten(m3).equals(v));
+
+  // C ordered int32 array, as written by np.save(f, np.arange(6).reshape(2,3))
+  std::string dict = "{'descr': '<i4', 'fortran_order': False, "
+                     "'shape': (2, 3), }";
+  std::string npy("\x93" "NUMPY\x01\x00", 8);
+  write_le16(npy, dict.size());
+  npy += dict;
+  for(int32_t i = 0; i < 6; ++i)
+    npy.append(reinterpret_cast<char*>(&i), sizeof(i));
+  Matrix m4;
+  assert(npy_read(npy.data(), npy.size(), m4));
+  assert(m4.equals(Matrix(2, 3, {0, 3, 1, 4, 2, 5})));
+  Vector v4;
+  assert(!npy_read(npy.data(), npy.size(), v4));
+
+  // Vectors from 1-D arrays and single row matrices
+  assert(saveNpy("/tmp/test_numpy.npy", v));
+  assert(loadNpyVector("/tmp/test_numpy.npy").equals(v));
+  assert(saveNpy("/tmp/test_numpy.npy", Matrix(1, 5, {1, 2, 3, 4, 5})));
+  assert(loadNpyVector("/tmp/test_numpy.npy").equals(v));
+
+  // Truncated headers are rejected
+  for(std::string truncated : {"{'descr': '<f8', 'fortran_order'",
+                               "{'descr': '<f8', 'fortran_order': True, ",
+                               "{'descr': '<f8, "}){
+    std::string bad("\x93" "NUMPY\x01\x00", 8);
+    write_le16(bad, truncated.size());
+    bad += truncated;
+    assert(!npy_parse_header(bad.data(), bad.size(), header));
+  }
+
+  std::cout << "OK.\n";
+}
+
+void test_npy_mmap(){
+  std::cout << "test_npy_mmap...\n";
+
+  Matrix m(100, 20);
+  for(size_t i = 0; i < m.size(); ++i)
+    m[i] = i;
+  saveNpy("/tmp/test_numpy.npy", m);
+
+  MatrixView view = mapNpy("/tmp/test_numpy.npy");
+  assert(view.shape() == m.shape());
+  assert(view(5, 7) == m(5, 7));
+  assert(view.getColumn(3).equals(m.getColumn(3)));
+  assert(view.copy().equals(m));
+
+  // Views keep the mapping alive
+  MatrixView copy = view;
+  view = MatrixView();
+  assert(copy(99, 19) == m(99, 19));
+
+  std::cout << "OK.\n";
+}
+
+void test_npz(){
+  std::cout << "test_npz...\n";
+
+  std::map<std::string, Matrix> arrays;
+  arrays["a"] = Matrix(3, 4, {0,1,2,3,4,5,6,7,8,9,10,11});
+  arrays["b"] = Matrix::ones(50, 60);
+
+  for(bool compress : {false, true}){
+    assert(saveNpz("/tmp/test_numpy.npz", arrays, compress));
+    std::map<std::string, Matrix> loaded = loadNpz("/tmp/test_numpy.npz");
+    assert(loaded.size() == 2);
+    assert(loaded["a"].equals(arrays["a"]));
+    assert(loaded["b"].equals(arrays["b"]));
+  }
+
+  std::cout << "OK.\n";
+}
+
+int main(){
+  test_npy();
+  test_npy_mmap();
+  test_npz();
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include <cassert>
+#include <stdexcept>
+
+#include "pml_matrix.hpp"
+#include "pml_pipeline.hpp"
+
+using namespace pml;
+
+void test_bounded_queue(){
+  std::cout << "test_bounded_queue...\n";
+
+  BoundedQueue<int> queue(2);
+  std::thread producer([&queue]{
+    for(int i = 0; i < 100; ++i)
+      queue.push(i);
+    queue.close();
+  });
+  int item, expected = 0;
+  while(queue.pop(item)){
+    assert(item == expected++);
+    assert(queue.size() <= 2);
+  }
+  assert(expected == 100);
+  producer.join();
+
+  std::cout << "OK.\n";
+}
+
+void test_prefetcher(){
+  std::cout << "test_prefetcher...\n";
+
+  // Write some files asynchronously
+  std::vector<std::string> files;
+  {
+    AsyncWriter<Matrix> writer;
+    for(size_t i = 0; i < 20; ++i){
+      files.push_back("/tmp/test_pipeline_" + std::to_string(i) + ".pml");
+      writer.write(files.back(), Matrix(3, 4, i));
+    }
+    writer.flush();
+  }
+
+  // Read them back in order
+  Prefetcher<Matrix> prefetcher(files, Matrix::load, 3, 3);
+  Matrix m;
+  size_t i = 0;
+  while(prefetcher.next(m)){
+    assert(prefetcher.filename() == files[i]);
+    assert(m.equals(Matrix(3, 4, i)));
+    ++i;
+  }
+  assert(i == files.size());
+
+  // Stopping early must not block
+  {
+    Prefetcher<Matrix> partial(files);
+    assert(partial.next(m));
+  }
+
+  std::cout << "OK.\n";
+}
+
+void test_errors(){
+  std::cout << "test_errors...\n";
+
+  // A failed load is rethrown by next() and the following files still load
+  std::vector<std::string> files = {"0", "1", "2", "3"};
+  Prefetcher<Matrix> prefetcher(files, [](const std::string &f){
+    if(f == "1")
+      throw std::runtime_error("cannot load " + f);
+    return Matrix(2, 2, std::stod(f));
+  }, 2, 2);
+  Matrix m;
+  size_t loaded = 0, failed = 0;
+  while(true){
+    try {
+      if(!prefetcher.next(m))
+        break;
+      assert(m.equals(Matrix(2, 2, std::stod(prefetcher.filename()))));
+      ++loaded;
+    } catch(const std::runtime_error &e){
+      assert(std::string(e.what()) == "cannot load 1");
+      ++failed;
+    }
+  }
+  assert(loaded == 3 && failed == 1);
+
+  // A failed write is rethrown by flush()
+  AsyncWriter<int> writer([](const std::string &f, const int &x){
+    if(x < 0)
+      throw std::runtime_error("cannot write " + f);
+  });
+  writer.write("a", 1);
+  writer.write("b", -1);
+  writer.write("c", 2);
+  bool thrown = false;
+  try {
+    writer.flush();
+  } catch(const std::runtime_error &e){
+    assert(std::string(e.what()) == "cannot write b");
+    thrown = true;
+  }
+  assert(thrown);
+  writer.flush();
+
+  // So is a failed save with the default writer
+  AsyncWriter<Matrix> saver;
+  saver.write("/nonexistent/test_pipeline.pml", Matrix(2, 2));
+  thrown = false;
+  try {
+    saver.flush();
+  } catch(const std::runtime_error &){
+    thrown = true;
+  }
+  assert(thrown);
+
+  std::cout << "OK.\n";
+}
+
+int main(){
+  test_bounded_queue();
+  test_prefetcher();
+  test_errors();
+  return 0;
+}
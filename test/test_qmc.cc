@@ -0,0 +1,123 @@
+#include <cassert>
+
+#include "pml_qmc.hpp"
+
+using namespace pml;
+
+// Checks that each of the n intervals [i/n, (i+1)/n) holds one point of
+// row d.
+bool stratified(const Matrix &X, size_t d, size_t n){
+  std::vector<size_t> counts(n, 0);
+  for(size_t j = 0; j < X.ncols(); ++j){
+    double x = X(d, j);
+    if(x < 0 || x >= 1)
+      return false;
+    ++counts[size_t(x * n)];
+  }
+  for(size_t count : counts)
+    if(count * n != X.ncols())
+      return false;
+  return true;
+}
+
+void test_sobol(){
+  std::cout << "test_sobol...\n";
+
+  // First points of the first three dimensions
+  Sobol sobol(3);
+  Matrix X = sobol.next(8);
+  Matrix expected(3, 8, {0,     0,     0,
+                         0.5,   0.5,   0.5,
+                         0.75,  0.25,  0.25,
+                         0.25,  0.75,  0.75,
+                         0.375, 0.375, 0.625,
+                         0.875, 0.875, 0.125,
+                         0.625, 0.125, 0.875,
+                         0.125, 0.625, 0.375});
+  assert(X.equals(expected));
+  assert(sobol.index() == 8);
+
+  // Every dimension is stratified, scrambled or not
+  Generator gen(42);
+  Sobol plain(Sobol::MAX_DIM), scrambled(Sobol::MAX_DIM, gen);
+  Matrix P = plain.next(1024), S = scrambled.next(1024);
+  for(size_t d = 0; d < Sobol::MAX_DIM; ++d){
+    assert(stratified(P, d, 1024));
+    assert(stratified(S, d, 1024));
+  }
+  assert(!P.equals(S));
+
+  // The first two dimensions form a (0, m, 2)-net
+  for(size_t a = 0; a <= 6; ++a){
+    std::vector<size_t> counts(64, 0);
+    for(size_t j = 0; j < 64; ++j)
+      ++counts[size_t(S(0, j) * (1 << a)) * (64 >> a) +
+               size_t(S(1, j) * (64 >> a))];
+    for(size_t count : counts)
+      assert(count == 1);
+  }
+
+  // Skipping ahead and parallel blocks give the same points
+  set_num_threads(4);
+  Matrix all = scrambled.next(3 * Sobol::BLOCK_SIZE + 17);
+  scrambled.seek(1024 + Sobol::BLOCK_SIZE + 5);
+  Matrix part = scrambled.next(Sobol::BLOCK_SIZE);
+  for(size_t j = 0; j < part.ncols(); ++j)
+    assert(part.getColumn(j).equals(all.getColumn(Sobol::BLOCK_SIZE + 5 + j)));
+
+  // Quasi Monte Carlo estimate of E[x' x] = 5 for x ~ N(0, I)
+  Sobol normal(5, gen);
+  Matrix Z = Gaussian().quantile(normal.next(1 << 14));
+  double estimate = 0;
+  for(size_t i = 0; i < Z.size(); ++i)
+    estimate += Z[i] * Z[i];
+  estimate /= Z.ncols();
+  assert(std::fabs(estimate - 5) < 0.01);
+
+  std::cout << "OK.\n";
+}
+
+void test_halton(){
+  std::cout << "test_halton...\n";
+
+  Halton halton(2);
+  halton.skip(1);
+  Matrix X = halton.next(4);
+  Matrix expected(2, 4, {0.5,   1.0 / 3,
+                         0.25,  2.0 / 3,
+                         0.75,  1.0 / 9,
+                         0.125, 4.0 / 9});
+  assert(X.equals(expected));
+  assert(halton.getBases() == std::vector<uint64_t>({2, 3}));
+
+  // Scrambled points stay stratified in each base
+  Generator gen(7);
+  Halton scrambled(100, gen);
+  assert(scrambled.getBases().back() == 541);
+  assert(stratified(scrambled.next(512), 0, 512));
+  scrambled.seek(0);
+  assert(stratified(scrambled.next(243), 1, 243));
+  scrambled.seek(0);
+  assert(stratified(scrambled.next(541), 99, 541));
+
+  // Skipping ahead gives the same points
+  scrambled.seek(0);
+  Matrix all = scrambled.next(5000);
+  scrambled.seek(3210);
+  Matrix part = scrambled.next(10);
+  for(size_t j = 0; j < part.ncols(); ++j)
+    assert(part.getColumn(j).equals(all.getColumn(3210 + j)));
+
+  // Uniform marginals
+  Matrix U = Uniform(-1, 3).quantile(all);
+  assert(min(U) >= -1 && max(U) < 3);
+  assert(std::fabs(mean(U) - 1) < 0.01);
+
+  std::cout << "OK.\n";
+}
+
+int main(){
+  test_sobol();
+  test_halton();
+  return 0;
+}
@@ -4,6 +4,9 @@
 
 #include "pml_random.hpp"
 #include <cassert>
+#include <map>
+#include <set>
+#include <thread>
 
 using namespace pml;
 
@@ -22,6 +25,19 @@ void test_dirichlet() {
   std::cout << "Original parameters : " << dir.alpha << std::endl;
   std::cout << "Estimated parameters: " << dir_est.alpha << std::endl;
 
+  // Exact sufficient statistics E[log x] give back alpha
+  for(Vector a : {alpha, Vector({0.1, 0.2, 0.05}), Vector({300, 20, 1})}){
+    Vector ss = psi(a) - psi(sum(a));
+    assert(sum(abs(Dirichlet::fit(ss).alpha - a)) < 1e-6 * sum(a));
+    assert(sum(abs(Dirichlet::fit(ss, sum(a)).alpha - a)) < 1e-4 * sum(a));
+  }
+
+  // Sufficient statistics do not depend on the number of threads
+  set_num_threads(1);
+  Vector alpha1 = Dirichlet::fit(data).alpha;
+  set_num_threads(3);
+  assert(Dirichlet::fit(data).alpha.equals(alpha1));
+
   std::cout << "OK.\n\n";
 }
 
@@ -65,8 +81,580 @@ void test_categorical(){
 }
 
 
+void test_generator(){
+  std::cout << "test_generator...\n";
+
+  // Same seed, same sequence
+  Generator g1(42), g2(42);
+  Vector v1 = Uniform().rand(100, g1);
+  Vector v2 = Uniform().rand(100, g2);
+  assert(v1.equals(v2));
+
+  // Stream k starts k jumps after stream 0
+  Generator s0(42), s2(42, 2);
+  s0.jump();
+  s0.jump();
+  assert(s0.uniform() == s2.uniform());
+
+  // split() continues the sequence and moves on to the next stream
+  Generator g3(7), g4(7), g5(7, 1);
+  Generator child = g3.split();
+  assert(child.uniform() == g4.uniform());
+  assert(g3.uniform() == g5.uniform());
+
+  // Different streams differ
+  Generator a(1, 0), b(1, 1);
+  assert(a.uniform() != b.uniform());
+
+  // Default generators are reproducible after rnd_set_seed
+  rnd_set_seed(123);
+  Vector d1 = Gaussian().rand(10);
+  rnd_set_seed(123);
+  Vector d2 = Gaussian().rand(10);
+  assert(d1.equals(d2));
+
+  // Each thread gets its own stream
+  const size_t num_threads = 4;
+  std::vector<double> first(num_threads);
+  std::vector<std::thread> threads;
+  for(size_t i = 0; i < num_threads; ++i)
+    threads.emplace_back([&first, i](){ first[i] = Uniform().rand(); });
+  for(auto &thread : threads)
+    thread.join();
+  std::sort(first.begin(), first.end());
+  assert(std::unique(first.begin(), first.end()) == first.end());
+
+  std::cout << "OK.\n\n";
+}
+
+void test_fill(){
+  std::cout << "test_fill...\n";
+
+  // Bulk uniforms are the same as single draws
+  Generator g1(5), g2(5);
+  Vector v1 = Uniform(2, 4).rand(1001, g1);
+  for(size_t i = 0; i < v1.size(); ++i)
+    assert(v1[i] == Uniform(2, 4).rand(g2));
+
+  const size_t n = 200001;
+  Generator gen(11);
+  Vector x = Gaussian(3, 2).rand(n, gen);
+  assert(std::fabs(mean(x) - 3) < 0.05);
+  assert(std::fabs(std::sqrt(sum(pow(x - mean(x), 2)) / n) - 2) < 0.05);
+
+  x = Bernoulli(0.3).rand(n, gen);
+  assert(std::fabs(mean(x) - 0.3) < 0.01);
+
+  for(double lambda : {0.5, 20.0, 100.0}){
+    x = Poisson(lambda).rand(n, gen);
+    double var = sum(pow(x - mean(x), 2)) / n;
+    assert(std::fabs(mean(x) - lambda) < 0.02 * lambda + 0.01);
+    assert(std::fabs(var - lambda) < 0.05 * lambda + 0.01);
+    for(double d : x)
+      assert(d >= 0 && d == std::floor(d));
+  }
+
+  // Matrices are filled in bulk too
+  Matrix m = Gaussian().rand(3, 5, gen);
+  assert(m.nrows() == 3 && m.ncols() == 5);
+
+  std::cout << "OK.\n\n";
+}
+
+void test_alias(){
+  std::cout << "test_alias...\n";
+
+  Vector p = {0.1, 0, 0.5, 0.15, 0.25};
+  Categorical cat(p);
+  Generator gen(3);
+
+  const size_t n = 200000;
+  std::vector<unsigned> samples(n);
+  cat.randi(samples.data(), n, gen);
+  Vector counts = Vector::zeros(p.size());
+  for(unsigned k : samples)
+    ++counts[k];
+  assert(counts[1] == 0);
+  for(size_t k = 0; k < p.size(); ++k)
+    assert(std::fabs(counts[k] / n - p[k]) < 0.01);
+
+  // Bulk and single draws agree
+  Generator g1(8), g2(8);
+  Vector x = cat.rand(100, g1);
+  for(double d : x)
+    assert(d == cat.rand(g2));
+
+  // Copies are independent of rebuilds
+  Categorical copy = cat;
+  cat.setProbabilities(Vector({0, 0, 1}));
+  for(double d : cat.rand(100, gen))
+    assert(d == 2);
+  assert(copy.p.equals(p));
+  assert(sum(copy.rand(1000, gen) == 1) == 0);
+
+  // Rebuilds with the same size keep the storage, also from p itself
+  const double *storage = cat.p.data();
+  cat.setProbabilities(Vector({2, 2, 4}));
+  cat.setProbabilities(cat.p);
+  assert(cat.p.data() == storage);
+  assert(cat.p.equals(Vector({0.25, 0.25, 0.5})));
+  assert(cat.log_pdf(2.0) == std::log(0.5));
+
+  std::cout << "OK.\n\n";
+}
+
+void test_parallel_rand(){
+  std::cout << "test_parallel_rand...\n";
+
+  // The same samples for any number of threads
+  std::vector<Matrix> gaussians, dirichlets;
+  for(size_t num_threads : {1, 3, 8}){
+    set_num_threads(num_threads);
+    Generator gen(2016);
+    gaussians.push_back(Gaussian().rand(1000, 300, gen));
+    dirichlets.push_back(Dirichlet(Vector({1, 2, 3})).rand(5000, gen));
+  }
+  for(size_t i = 1; i < gaussians.size(); ++i){
+    assert(gaussians[i].equals(gaussians[0]));
+    assert(dirichlets[i].equals(dirichlets[0]));
+  }
+  assert(dirichlets[0].nrows() == 3 && dirichlets[0].ncols() == 5000);
+  assert(std::fabs(mean(flatten(gaussians[0]))) < 0.01);
+
+  // Blocks use different streams
+  Vector x(2 * Distribution1D::BLOCK_SIZE);
+  Uniform().fill(x.data(), x.size(), uint64_t(7));
+  assert(x[0] != x[Distribution1D::BLOCK_SIZE]);
+
+  std::cout << "OK.\n\n";
+}
+
+void test_multinomial(){
+  std::cout << "test_multinomial...\n";
+
+  Vector p = {0.2, 0, 0.5, 0.3};
+  Multinomial mult(p, 20);
+  Generator gen(17);
+  Matrix X = mult.rand(20000, gen);
+  assert(X.nrows() == 4 && X.ncols() == 20000);
+  for(double total : sum(X, 0))
+    assert(total == 20);
+  assert(sum(X.getRow(1)) == 0);
+  Vector m = mean(X, 1);
+  for(size_t k = 0; k < p.size(); ++k)
+    assert(std::fabs(m[k] - 20 * p[k]) < 0.1);
+
+  // Two categories are binomial
+  Multinomial two({0.3, 0.7}, 10);
+  Binomial binom(0.3, 10);
+  assert(fequal(two.log_pmf(Vector({4, 6})), binom.log_pmf(10, 4)));
+  assert(fequal(two.pmf(Vector({0, 10})), std::pow(0.7, 10)));
+
+  // Columns are scored at once
+  Vector scores = mult.log_pmf(X);
+  for(size_t j = 0; j < 10; ++j)
+    assert(fequal(scores[j], mult.log_pmf(X.getColumn(j))));
+  assert(std::isinf(mult.log_pmf(Vector({1, 0, 1, 1}))));
+  assert(std::isinf(mult.log_pmf(Vector({10, 5, 5, 0}))));
+
+  std::cout << "OK.\n\n";
+}
+
+// A distribution that does not report its dimension.
+class Pair : public DistributionND {
+  public:
+    Vector randgen(Generator &gen) override {
+      return {gen.uniform(), 2.0};
+    }
+
+    using DistributionND::log_pdf;
+
+    void log_pdf(const double *X, size_t ncols, double *out) const override {
+      for(size_t j = 0; j < ncols; ++j)
+        out[j] = X[2 * j + 1] == 2 ? 0 : -1;
+    }
+};
+
+// Implements sampling only.
+class Constant : public Distribution1D {
+  public:
+    double randgen(Generator &) const override {
+      return 4;
+    }
+};
+
+void test_unknown_dim(){
+  std::cout << "test_unknown_dim...\n";
+
+  Pair pair;
+  Generator gen(3);
+  Matrix X = pair.rand(5, gen);
+  assert(pair.dim() == 0);
+  assert(X.nrows() == 2 && X.ncols() == 5);
+  assert(all(X.getRow(1) == 2));
+  assert(pair.log_likelihood(X) == 0);
+
+  // Subclasses without a density still sample
+  assert(all(Constant().rand(10, gen) == 4));
+
+  // The old randgen() uses the global generator
+  const Distribution1D &constant = Constant();
+  assert(constant.randgen() == 4);
+  double u = Uniform(2, 3).randgen();
+  assert(u >= 2 && u < 3);
+  assert(Dirichlet(Vector({1, 1})).randgen().size() == 2);
+
+  std::cout << "OK.\n\n";
+}
+
+void test_log_pdf(){
+  std::cout << "test_log_pdf...\n";
+
+  double inf = std::numeric_limits<double>::infinity();
+
+  Gaussian gauss(1, 2);
+  assert(fequal(gauss.log_pdf(2.0),
+                -0.5 * std::log(2 * M_PI * 4) - 1.0 / 8));
+
+  Gamma gamma(3, 2);
+  assert(fequal(gamma.log_pdf(1.5),
+                2 * std::log(1.5) - 0.75 - std::lgamma(3) - 3 * std::log(2)));
+  assert(gamma.log_pdf(-1.0) == -inf);
+
+  Poisson poisson(4);
+  assert(fequal(poisson.log_pdf(3.0), 3 * std::log(4) - 4 - std::log(6)));
+  assert(poisson.log_pdf(2.5) == -inf);
+  assert(fequal(Poisson(0).log_pdf(0.0), 0));
+
+  Bernoulli bern(0.2);
+  assert(fequal(bern.log_pdf(1.0), std::log(0.2)));
+  assert(fequal(bern.log_pdf(0.0), std::log(0.8)));
+
+  Categorical cat(Vector({1, 3}));
+  assert(fequal(cat.log_pdf(1.0), std::log(0.75)));
+  assert(cat.log_pdf(2.0) == -inf);
+
+  Binomial binom(0.4, 5);
+  assert(fequal(binom.log_pdf(2.0), std::log(10 * 0.16 * 0.216)));
+  assert(fequal(binom.log_pmf(5, 2), binom.log_pdf(2.0)));
+  assert(fequal(Binomial(0, 5).log_pdf(0.0), 0));
+  assert(binom.log_pdf(6.0) == -inf);
+
+  // Counts beyond the log factorial table and beyond size_t
+  assert(fequal(log_factorial(4), std::log(24)));
+  double n = 3 * LOG_FACTORIAL_TABLE_SIZE;
+  assert(fequal(log_factorial(n), std::lgamma(n + 1)));
+  assert(fequal(poisson.log_pdf(1e30),
+                1e30 * std::log(4) - 4 - std::lgamma(1e30 + 1)));
+  Binomial many(0.5, 10000000);
+  assert(fequal(many.log_pdf(5000000.0), many.log_pmf(10000000, 5000000)));
+  assert(fequal(Multinomial({0.5, 0.5}, 10000000).log_pmf(
+      Vector({5000000, 5000000})), many.log_pdf(5000000.0)));
+
+  assert(fequal(Uniform(0, 4).log_pdf(1.0), -std::log(4)));
+  assert(Uniform(0, 4).log_pdf(5.0) == -inf);
+
+  Dirichlet dir(Vector({1, 2, 3}));
+  Vector x = {0.2, 0.3, 0.5};
+  assert(fequal(dir.log_pdf(x), std::lgamma(6) - std::lgamma(2) -
+                std::lgamma(3) + std::log(0.3) + 2 * std::log(0.5)));
+  Matrix X = dir.rand(10);
+  Vector scores = dir.log_pdf(X);
+  for(size_t j = 0; j < X.ncols(); ++j)
+    assert(fequal(scores[j], dir.log_pdf(X.getColumn(j))));
+
+  // Elementwise on Vectors and Matrices
+  Vector data = gamma.rand(10);
+  Vector lp = gamma.log_pdf(data);
+  for(size_t i = 0; i < data.size(); ++i)
+    assert(fequal(lp[i], gamma.log_pdf(data[i])));
+  Matrix lpm = gamma.log_pdf(Matrix(2, 3, 1.0));
+  assert(lpm.nrows() == 2 && lpm.ncols() == 3);
+
+  // The log likelihood does not depend on the number of threads
+  Vector big = gauss.rand(100000);
+  set_num_threads(1);
+  double ll1 = gauss.log_likelihood(big);
+  set_num_threads(5);
+  double ll5 = gauss.log_likelihood(big);
+  assert(ll1 == ll5);
+  assert(std::fabs(ll1 - sum(gauss.log_pdf(big))) < 1e-6 * std::fabs(ll1));
+
+  std::cout << "OK.\n\n";
+}
+
+void test_stats(){
+  std::cout << "test_stats...\n";
+
+  Generator gen(99);
+
+  // Chunks and merges give the same fit as the whole data
+  Vector x = Gaussian(5, 2).rand(10000, gen);
+  GaussianStats g1, g2;
+  for(size_t i = 0; i < 3000; ++i)
+    g1.add(x[i]);
+  g2.add(Vector(7000, x.data() + 3000));
+  g1.merge(g2);
+  Gaussian fitted = GaussianStats::deserialize(g1.serialize()).fit();
+  Gaussian direct = Gaussian::fit(x);
+  assert(fequal(fitted.mu, direct.mu) && fequal(fitted.sigma, direct.sigma));
+
+  x = Gamma(3, 2).rand(10000, gen);
+  GammaStats gs1, gs2;
+  gs1.add(Vector(5000, x.data()));
+  gs2.add(Vector(5000, x.data() + 5000));
+  gs1.merge(GammaStats::deserialize(gs2.serialize()));
+  Gamma gamma = gs1.fit(), gamma_direct = Gamma::fit(x);
+  assert(fequal(gamma.a, gamma_direct.a) && fequal(gamma.b, gamma_direct.b));
+
+  Matrix X = Dirichlet(Vector({1, 2, 3})).rand(5000, gen);
+  DirichletStats ds1(3), ds2(3);
+  ds1.add(X.getColumns(Range(0, 1000)));
+  for(size_t j = 1000; j < X.ncols(); ++j)
+    ds2.add(X.getColumn(j));
+  ds1.merge(DirichletStats::deserialize(ds2.serialize()));
+  assert(ds1.n == 5000);
+  assert(ds1.fit().alpha.equals(Dirichlet::fit(X).alpha));
+
+  CategoricalStats cs(3);
+  cs.add(Vector({0, 2, 2, 1}));
+  CategoricalStats cs2 = CategoricalStats::deserialize(cs.serialize());
+  cs2.add(2);
+  cs.merge(cs2);
+  assert(cs.counts.equals(Vector({2, 2, 5})));
+  assert(cs.fit().p.equals(Vector({2, 2, 5}) / 9));
+
+  std::cout << "OK.\n\n";
+}
+
+void test_gamma_sampler(){
+  std::cout << "test_gamma_sampler...\n";
+
+  Generator gen(31);
+  const size_t n = 200000;
+  for(double a : {0.3, 1.0, 5.0, 50.0}){
+    Gamma gamma(a, 2);
+    Vector x = gamma.rand(n, gen);
+    double m = mean(x), var = sum(pow(x - m, 2)) / n;
+    assert(std::fabs(m - 2 * a) < 0.02 * 2 * a);
+    assert(std::fabs(var - 4 * a) < 0.05 * 4 * a);
+    assert(min(x) >= 0);
+
+    // Single draws
+    double total = 0;
+    for(size_t i = 0; i < 20000; ++i)
+      total += gamma.rand(gen);
+    assert(std::fabs(total / 20000 - 2 * a) < 0.05 * 2 * a);
+  }
+
+  // Shorter draws are prefixes of longer ones
+  for(double a : {0.3, 1.0, 5.0}){
+    Generator g1(77), g2(77);
+    Vector x = Gamma(a, 1).rand(1000, g1), prefix = Gamma(a, 1).rand(300, g2);
+    for(size_t i = 0; i < prefix.size(); ++i)
+      assert(prefix[i] == x[i]);
+  }
+
+  // Dirichlet columns lie on the simplex and have mean alpha / sum(alpha)
+  Vector alpha = {0.5, 1, 3.5};
+  Matrix X = Dirichlet(alpha).rand(50000, gen);
+  for(double total : sum(X, 0))
+    assert(fequal(total, 1));
+  Vector m = mean(X, 1);
+  for(size_t k = 0; k < alpha.size(); ++k)
+    assert(std::fabs(m[k] - alpha[k] / 5) < 0.01);
+
+  // Tiny alphas underflow but still give valid samples
+  X = Dirichlet(Vector({0.001, 0.001})).rand(1000, gen);
+  for(double total : sum(X, 0))
+    assert(fequal(total, 1));
+
+  std::cout << "OK.\n\n";
+}
+
+void test_philox(){
+  std::cout << "test_philox...\n";
+
+  // Known answers of Philox4x32-10
+  uint32_t out[4];
+  uint32_t zero_counter[4] = {0, 0, 0, 0}, zero_key[2] = {0, 0};
+  philox4x32_10(zero_counter, zero_key, out);
+  assert(out[0] == 0x6627e8d5 && out[1] == 0xe169c58d &&
+         out[2] == 0xbc57ac4c && out[3] == 0x9b00dbd8);
+  uint32_t ones_counter[4] = {~0u, ~0u, ~0u, ~0u}, ones_key[2] = {~0u, ~0u};
+  philox4x32_10(ones_counter, ones_key, out);
+  assert(out[0] == 0x408f276d && out[1] == 0x41c83b0e &&
+         out[2] == 0xa20bc7c6 && out[3] == 0x6d5451fd);
+
+  // Any position is reached directly
+  Generator gen = Generator::philox(42, 3);
+  Vector x(1001);
+  gen.uniform(x.data(), x.size());
+  assert(gen.offset() == 1001);
+  for(size_t i : {0, 1, 2, 500, 777, 1000}){
+    Generator g = Generator::philox(42, 3, i);
+    assert(g.uniform() == x[i]);
+    gen.seek(i);
+    assert(gen.uniform() == x[i]);
+  }
+  // Bulk draws from odd offsets
+  Generator odd = Generator::philox(42, 3, 5);
+  Vector y(10);
+  odd.uniform(y.data(), y.size());
+  for(size_t i = 0; i < y.size(); ++i)
+    assert(y[i] == x[5 + i]);
+
+  // Streams
+  Generator g1 = Generator::philox(42), g2 = Generator::philox(42, 1);
+  Generator child = g1.split();
+  assert(g1.uniform() == g2.uniform());
+  assert(child.uniform() != Generator::philox(42, 1).uniform());
+
+  // Works with the distributions and gsl samplers
+  Generator pg = Generator::philox(7);
+  assert(std::fabs(mean(Gamma(2, 3).rand(20000, pg)) - 6) < 0.2);
+  assert(std::fabs(mean(Poisson(200).rand(20000, pg)) - 200) < 1);
+
+  // Parts of a seeded sequence are regenerated exactly
+  size_t n = 3 * Distribution1D::BLOCK_SIZE + 17;
+  Vector all(n), part(Distribution1D::BLOCK_SIZE + 100);
+  Gaussian().fill(all.data(), n, uint64_t(5));
+  size_t first = Distribution1D::BLOCK_SIZE - 50;
+  Gaussian().fill(part.data(), part.size(), uint64_t(5), first);
+  for(size_t i = 0; i < part.size(); ++i)
+    assert(part[i] == all[first + i]);
+
+  // Also for samplers with rejections, and within the last block
+  Gamma small_shape(0.5, 1), large_shape(3, 2);
+  Poisson table(4), gsl(80);
+  std::vector<const Distribution1D*> dists = {&small_shape, &large_shape,
+                                              &table, &gsl};
+  for(const Distribution1D *dist : dists){
+    dist->fill(all.data(), n, uint64_t(9));
+    for(size_t start : {first, n - 30}){
+      size_t m = std::min(part.size(), n - start);
+      dist->fill(part.data(), m, uint64_t(9), start);
+      for(size_t i = 0; i < m; ++i)
+        assert(part[i] == all[start + i]);
+    }
+  }
+  Dirichlet dirichlet(Vector({0.5, 1, 2}));
+  size_t ncols = 2 * DistributionND::BLOCK_SIZE + 5;
+  Matrix columns(3, ncols), some(3, 100);
+  dirichlet.fill(columns.data(), ncols, uint64_t(9));
+  for(size_t start : {DistributionND::BLOCK_SIZE - 50, ncols - 100}){
+    dirichlet.fill(some.data(), 100, uint64_t(9), start);
+    for(size_t j = 0; j < 100; ++j)
+      assert(some.getColumn(j).equals(columns.getColumn(start + j)));
+  }
+
+  std::cout << "OK.\n\n";
+}
+
+bool is_permutation(std::vector<size_t> perm){
+  std::sort(perm.begin(), perm.end());
+  for(size_t i = 0; i < perm.size(); ++i)
+    if(perm[i] != i)
+      return false;
+  return true;
+}
+
+Vector sorted(Vector v){
+  std::sort(v.begin(), v.end());
+  return v;
+}
+
+void test_permutations(){
+  std::cout << "test_permutations...\n";
+
+  Generator gen(1234);
+
+  // All 6 permutations of 3 elements are equally likely
+  std::map<std::vector<size_t>, size_t> counts;
+  for(size_t i = 0; i < 60000; ++i)
+    ++counts[randperm(3, gen)];
+  assert(counts.size() == 6);
+  for(auto &count : counts)
+    assert(std::fabs(count.second / 60000.0 - 1.0 / 6) < 0.01);
+
+  // Large permutations are generated in parallel, independent of threads
+  size_t n = PARALLEL_PERMUTATION_SIZE + 12345;
+  set_num_threads(1);
+  Generator g1(8);
+  std::vector<size_t> p1 = randperm(n, g1);
+  set_num_threads(4);
+  Generator g2(8);
+  std::vector<size_t> p2 = randperm(n, g2);
+  assert(p1 == p2);
+  assert(is_permutation(p1));
+  size_t fixed_points = 0;
+  for(size_t i = 0; i < n; ++i)
+    fixed_points += p1[i] == i;
+  assert(fixed_points < 10);
+
+  // In place shuffles
+  Vector v(Range(0, 1000));
+  shuffle(v, gen);
+  assert(!v.equals(Vector(Range(0, 1000))));
+  assert(sorted(v).equals(Vector(Range(0, 1000))));
+
+  Vector big(n);
+  for(size_t i = 0; i < n; ++i)
+    big[i] = i;
+  shuffle(big, gen);
+  assert(sum(big) == double(n) * (n - 1) / 2);
+
+  Matrix X(3, 50);
+  for(size_t j = 0; j < X.ncols(); ++j)
+    X.setColumn(j, Vector({double(j), 2.0 * j, 3.0 * j}));
+  std::vector<size_t> perm = randperm(50, gen);
+  Matrix Y = X;
+  permute_columns(Y, perm);
+  for(size_t j = 0; j < X.ncols(); ++j)
+    assert(Y.getColumn(j).equals(X.getColumn(perm[j])));
+  shuffle_columns(X, gen);
+  assert(sorted(X.getRow(0)).equals(Vector(Range(0, 50))));
+
+  // Sampling without replacement, both algorithms
+  for(size_t k : {5, 900, 1000}){
+    std::vector<size_t> sample = randsample(1000, k, gen);
+    assert(sample.size() == k);
+    std::set<size_t> distinct(sample.begin(), sample.end());
+    assert(distinct.size() == k && *distinct.rbegin() < 1000);
+  }
+  Vector hits = Vector::zeros(100);
+  for(size_t i = 0; i < 20000; ++i)
+    for(size_t j : randsample(100, 5, gen))
+      ++hits[j];
+  assert(min(hits) > 800 && max(hits) < 1200);
+
+  // Weighted sampling without replacement
+  Vector weights = {1, 0, 2, 7};
+  std::vector<size_t> all = randsample(weights, 3, gen);
+  assert(std::set<size_t>(all.begin(), all.end()) ==
+         std::set<size_t>({0, 2, 3}));
+  Vector first = Vector::zeros(4);
+  for(size_t i = 0; i < 20000; ++i)
+    ++first[randsample(weights, 1, gen)[0]];
+  for(size_t k = 0; k < 4; ++k)
+    assert(std::fabs(first[k] / 20000 - weights[k] / 10) < 0.015);
+
+  std::cout << "OK.\n\n";
+}
+
 int main(){
 
+  test_generator();
+  test_fill();
+  test_alias();
+  test_parallel_rand();
+  test_multinomial();
+  test_unknown_dim();
+  test_log_pdf();
+  test_stats();
+  test_gamma_sampler();
+  test_philox();
+  test_permutations();
   test_dirichlet();
   test_gamma();
   test_categorical();
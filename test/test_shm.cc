@@ -0,0 +1,68 @@
+#include <cassert>
+#include <sys/wait.h>
+
+#include "pml_shm.hpp"
+
+using namespace pml;
+
+void test_publish(){
+  std::cout << "test_publish...\n";
+
+  shm_remove("test_shm");
+  Matrix m(50, 8);
+  for(size_t i = 0; i < m.size(); ++i)
+    m[i] = i * 0.5;
+
+  {
+    MatrixView published = shm_publish("test_shm", m);
+    assert(!published.empty());
+    assert(published.copy().equals(m));
+
+    // The name is taken
+    assert(shm_publish("/test_shm", m).empty());
+
+    // Another process maps the same data
+    pid_t pid = fork();
+    if(pid == 0){
+      bool ok;
+      {
+        MatrixView view = shm_attach("test_shm");
+        ok = view.shape() == m.shape() && view.copy().equals(m) &&
+             view.getColumn(3).equals(m.getColumn(3));
+      }
+      _exit(ok ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // Attached views keep the segment alive
+    MatrixView attached = shm_attach("test_shm");
+    assert(attached(7, 2) == m(7, 2));
+    published = MatrixView();
+    assert(!shm_attach("test_shm").empty());
+  }
+
+  // Released by the last view
+  assert(shm_attach("test_shm").empty());
+  assert(!shm_remove("test_shm"));
+
+  // Vectors
+  Vector v({1, 2, 3});
+  MatrixView vp = shm_publish("test_shm", v);
+  assert(vp.nrows() == 3 && vp.ncols() == 1);
+  assert(flatten(shm_attach("test_shm").copy()).equals(v));
+
+  // A segment too small for its shape is not mapped
+  int fd = shm_open("/test_shm", O_RDWR, 0);
+  assert(fd >= 0 && ftruncate(fd, ShmSegment::page_size()) == 0);
+  close(fd);
+  assert(shm_attach("test_shm").empty());
+
+  std::cout << "OK.\n";
+}
+
+int main(){
+  test_publish();
+  return 0;
+}
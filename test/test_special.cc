@@ -1,4 +1,5 @@
 #include <cassert>
+#include <thread>
 
 #include "pml_special.hpp"
 
@@ -23,8 +24,252 @@ void test_special(){
 
 }
 
+bool close(double x, double y, double tol = 1e-14){
+  return std::fabs(x - y) <= tol * std::max(1.0, std::fabs(y));
+}
+
+void test_gammaln(){
+
+  std::cout << "test_gammaln()...\n";
+
+  Vector x(5000);
+  for(size_t i = 0; i < x.size(); ++i)
+    x[i] = -20.5 + 0.0123 * i;
+  Vector y = gammaln(x);
+  for(size_t i = 0; i < x.size(); ++i){
+    assert(close(y[i], std::lgamma(x[i]), 1e-13));
+    assert(close(y[i], gammaln(x[i]), 1e-14));
+  }
+  assert(close(gammaln(1e-300), std::lgamma(1e-300)));
+  assert(close(gammaln(1e15), std::lgamma(1e15)));
+  assert(std::isinf(gammaln(0.0)) && std::isinf(gammaln(-2.0)));
+  const double inf = std::numeric_limits<double>::infinity();
+  assert(gammaln(inf) == inf);
+  assert(gammaln(Vector({1, inf, 2}))[1] == inf);
+
+  // Relative error next to the zeros at 1 and 2.
+  Vector near_zeros({1 - 1e-12, 1 - 1e-9, 1 + 1e-9, 1.2, 0.8,
+                     2 - 1e-9, 2 + 1e-12, 2.2, 1.8, 1.5});
+  Vector lg = gammaln(near_zeros);
+  for(size_t i = 0; i < near_zeros.size(); ++i){
+    double expected = std::lgamma(near_zeros[i]);
+    assert(std::fabs(lg[i] - expected) <= 1e-14 * std::fabs(expected));
+    assert(lg[i] == gammaln(near_zeros[i]));
+  }
+  assert(gammaln(1.0) == 0 && gammaln(2.0) == 0);
+
+  assert(close(log_beta(Vector({1, 1})), 0));
+  assert(close(log_beta(Vector({2, 3})), -std::log(12)));
+  Matrix alpha(3, 2, {1, 2, 3, 0.5, 0.5, 0.5});
+  Vector lb = log_beta(alpha);
+  assert(close(lb[0], std::log(2) - std::log(120)));
+  assert(close(lb[1], 1.5 * std::log(M_PI) - std::lgamma(1.5)));
+
+  assert(close(multi_gammaln(3.2, 1), gammaln(3.2)));
+  assert(close(multi_gammaln(3.2, 2),
+               0.5 * std::log(M_PI) + gammaln(3.2) + gammaln(2.7)));
+  assert(close(multi_gammaln(Matrix(1, 1, {4}), 3)[0],
+               1.5 * std::log(M_PI) + gammaln(4) + gammaln(3.5) + gammaln(3)));
+
+  std::cout << "OK.\n";
+
+}
+
+void test_polygamma(){
+
+  std::cout << "test_polygamma()...\n";
+
+  const double euler = 0.5772156649015329;
+  assert(close(digamma(1), -euler));
+  assert(close(digamma(0.5), -euler - 2 * std::log(2)));
+  assert(close(digamma(10), 2.251752589066721));
+  assert(close(digamma(-0.5), 0.03648997397857652));
+  assert(close(digamma(1e-8), -1e8 - euler, 1e-15));
+  assert(close(digamma(1e10), std::log(1e10) - 0.5e-10));
+  assert(std::isnan(digamma(0)) && std::isnan(digamma(-3)));
+
+  assert(close(trigamma(1), M_PI * M_PI / 6));
+  assert(close(trigamma(0.5), M_PI * M_PI / 2));
+  assert(close(trigamma(-0.5), M_PI * M_PI / 2 + 4));
+  assert(close(trigamma(25.5), trigamma(24.5) - 1 / (24.5 * 24.5)));
+  assert(std::isnan(trigamma(-1)));
+
+  assert(close(polygamma(2, 1), -2.4041138063191885));
+  assert(close(polygamma(3, 1), std::pow(M_PI, 4) / 15));
+  assert(close(polygamma(2, 3.5), polygamma(2, 2.5) + 2 / std::pow(2.5, 3)));
+  assert(std::isnan(polygamma(2, -1.5)));
+
+  // The batch versions agree with the scalar ones
+  Vector x(Range(0, 2000));
+  x = (x - 400) / 37.0;
+  for(int n = 0; n <= 2; ++n){
+    Vector y = psi(x, n);
+    for(size_t i = 0; i < x.size(); ++i)
+      assert((std::isnan(y[i]) && std::isnan(psi(x[i], n))) ||
+             close(y[i], psi(x[i], n), 1e-13));
+  }
+
+  std::cout << "OK.\n";
+
+}
+
+void test_inv_psi(){
+
+  std::cout << "test_inv_psi()...\n";
+
+  Vector x(1000);
+  for(size_t i = 0; i < x.size(); ++i)
+    x[i] = std::pow(10, -3 + 6.0 * i / x.size());
+  Vector dx = psi(x);
+  Vector y = inv_psi(dx);
+  for(size_t i = 0; i < x.size(); ++i){
+    assert(close(y[i], x[i], 1e-10));
+    // Each input converges on its own, as if it were alone in its block.
+    assert(y[i] == inv_psi(dx[i]));
+  }
+
+  double d0, d1;
+  digamma_trigamma(0.3, d0, d1);
+  assert(close(d0, digamma(0.3)) && close(d1, trigamma(0.3)));
+
+  Matrix m(2, 2, {-5, 0, 1, 3});
+  Matrix inv = inv_psi(m);
+  for(size_t i = 0; i < m.size(); ++i)
+    assert(close(digamma(inv[i]), m[i], 1e-12));
+
+  std::cout << "OK.\n";
+
+}
+
+void test_special_table(){
+
+  std::cout << "test_special_table()...\n";
+
+  SpecialTable counts;
+  assert(counts.gammaln(1) == 0 && counts.gammaln(2) == 0);
+  assert(close(counts.gammaln(5), std::log(24)));
+  assert(std::isinf(counts.gammaln(0)));
+
+  // Tabulated and computed values agree, also beyond max_size
+  SpecialTable table(0.25, 10000);
+  for(size_t n = 0; n < 20000; n += 7){
+    assert(close(table.gammaln(n), gammaln(n + 0.25)));
+    assert(close(table.psi(n), psi(n + 0.25)));
+  }
+  assert(table.getAlpha() == 0.25);
+
+  // Concurrent readers fill the chunks once
+  SpecialTable shared(0.5);
+  std::vector<std::thread> threads;
+  std::atomic<bool> ok(true);
+  for(size_t t = 0; t < 4; ++t){
+    threads.emplace_back([&shared, &ok, t](){
+      for(size_t n = t; n < 100000; n += 3)
+        if(shared.psi(n) != digamma(n + 0.5) ||
+           shared.gammaln(n) != gammaln(n + 0.5))
+          ok = false;
+    });
+  }
+  for(auto &thread : threads)
+    thread.join();
+  assert(ok);
+
+  std::cout << "OK.\n";
+
+}
+
+bool same(double x, double y){
+  return (std::isinf(x) && std::isinf(y)) || close(x, y, 1e-12);
+}
+
+void test_divergences(){
+
+  std::cout << "test_divergences()...\n";
+
+  Vector p = {1, 0}, q = {0, 1};
+  assert(close(js_div(p, q), std::log(2)));
+  assert(close(hellinger(p, q), 1));
+  assert(std::isinf(kl_div(p, q)) && std::isinf(symmetric_kl_div(p, q)));
+  Vector r = {0.5, 0.5}, t = {0.25, 0.75};
+  assert(close(kl_div(r, t), 0.5 * std::log(2) + 0.5 * std::log(2.0 / 3)));
+  assert(close(symmetric_kl_div(r, t), kl_div(r, t) + kl_div(t, r)));
+  assert(close(kl_div(Vector({0, 2}), Vector({1, 2})), 1));
+  assert(std::isinf(kl_div(Vector({-1}), Vector({1}))));
+
+  // Histograms, some with empty bins
+  Matrix X(4, 5, {0.1, 0.2, 0.3, 0.4,   0.25, 0.25, 0.25, 0.25,
+                  0.5, 0.5, 0, 0,       0, 0.1, 0.9, 0,
+                  0.7, 0.1, 0.1, 0.1});
+  Matrix Y(4, 3, {0.4, 0.3, 0.2, 0.1,   0.5, 0, 0.5, 0,
+                  0.3, 0.3, 0.3, 0.1});
+
+  Matrix Z = Y;
+  Z.appendColumn(Vector({0.25, 0.25, 0.25, 0.25}));
+  Z.appendColumn(Vector({0.1, 0.2, 0.3, 0.4}));
+  Vector kl = kl_div(X, Z, 0), js = js_div(X, Z, 1);
+  for(size_t j = 0; j < X.ncols(); ++j)
+    assert(same(kl[j], kl_div(X.getColumn(j), Z.getColumn(j))));
+  for(size_t i = 0; i < X.nrows(); ++i)
+    assert(same(js[i], js_div(X.getRow(i), Z.getRow(i))));
+  assert(std::isinf(kl[1]) && kl[3] > 0);
+  assert(same(kl_div(X, Z), kl_div(flatten(X), flatten(Z))));
+  assert(same(hellinger(X, Z), hellinger(flatten(X), flatten(Z))));
+  assert(same(sum(symmetric_kl_div(X, X, 0)), 0));
+
+  // Pairwise versions agree with the pairs
+  Matrix D1 = kl_div_pairwise(X, Y), D2 = symmetric_kl_div_pairwise(X, Y),
+         D3 = js_div_pairwise(X, Y), D4 = hellinger_pairwise(X, Y);
+  assert(D1.nrows() == 5 && D1.ncols() == 3);
+  for(size_t i = 0; i < X.ncols(); ++i){
+    for(size_t j = 0; j < Y.ncols(); ++j){
+      Vector x = X.getColumn(i), y = Y.getColumn(j);
+      assert(same(D1(i, j), kl_div(x, y)));
+      assert(same(D2(i, j), symmetric_kl_div(x, y)));
+      assert(same(D3(i, j), js_div(x, y)));
+      assert(same(D4(i, j), hellinger(x, y)));
+    }
+  }
+  assert(std::isinf(D1(2, 1)) && !std::isinf(D1(2, 0)));
+  assert(std::isinf(D2(2, 1)) && std::isinf(D2(3, 0)));
+
+  // Negative entries give inf, pairwise too
+  assert(std::isinf(hellinger(Vector({-1}), Vector({1}))));
+  Matrix N = Y;
+  N(1, 2) = -0.1;
+  Matrix H = hellinger_pairwise(X, N);
+  for(size_t i = 0; i < X.ncols(); ++i)
+    assert(std::isinf(H(i, 2)) && same(H(i, 0), D4(i, 0)));
+
+  std::cout << "OK.\n";
+
+}
+
+void test_normal_quantile(){
+
+  std::cout << "test_normal_quantile()...\n";
+
+  assert(normal_quantile(0.5) == 0);
+  assert(std::fabs(normal_quantile(0.975) - 1.959963984540054) < 1e-14);
+  for(double p : {1e-300, 1e-20, 1e-5, 0.01, 0.02425, 0.3, 0.7, 0.99}){
+    double x = normal_quantile(p);
+    assert(std::fabs(normal_quantile(1 - p) + x) < 1e-8 * std::fabs(x) + 1e-12
+           || p < 1e-16);
+    assert(std::fabs(0.5 * std::erfc(-x / M_SQRT2) - p) < 1e-12 * p);
+  }
+  assert(std::isinf(normal_quantile(0)) && normal_quantile(0) < 0);
+  assert(std::isinf(normal_quantile(1)) && normal_quantile(1) > 0);
+
+  std::cout << "OK.\n";
+
+}
 
 int main(){
   test_special();
+  test_gammaln();
+  test_polygamma();
+  test_inv_psi();
+  test_special_table();
+  test_divergences();
+  test_normal_quantile();
   return 0;
 }
\ No newline at end of file
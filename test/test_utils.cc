@@ -0,0 +1,93 @@
+#include <cassert>
+
+#include "pml_utils.hpp"
+
+using namespace pml;
+
+std::string test_dir = "/tmp/pml test_utils";
+
+void test_files(){
+  std::cout << "test_files...\n";
+
+  // Nested directories and file names with spaces
+  assert(find_or_create(path_join({test_dir, "a b/c"})));
+  assert(dir_exists(path_join({test_dir, "a b/c"})));
+  assert(find_or_create(path_join({test_dir, "a b/c"})));
+
+  std::string file = path_join({test_dir, "a b/my file.txt"});
+  std::ofstream ofs(file);
+  for(int i = 0; i < 10000; ++i)
+    ofs << i << "\n";
+  ofs.close();
+
+  // Zip & unzip
+  std::string zipped = file + ".gz", unzipped = file + ".out";
+  assert(zip(file, zipped));
+  assert(unzip(zipped, unzipped));
+  std::ifstream f1(file), f2(unzipped);
+  std::string s1((std::istreambuf_iterator<char>(f1)),
+                 std::istreambuf_iterator<char>());
+  std::string s2((std::istreambuf_iterator<char>(f2)),
+                 std::istreambuf_iterator<char>());
+  assert(s1 == s2);
+  assert(!zip(file + ".missing", zipped));
+
+  // Remove
+  assert(rm(unzipped));
+  assert(!file_exists(unzipped));
+  assert(!rm(unzipped));
+
+  std::cout << "OK.\n";
+}
+
+void test_ls(){
+  std::cout << "test_ls...\n";
+
+  assert(ends_with("data.txt", {".pml", ".txt"}));
+  assert(!ends_with("data.txt.gz", {".pml", ".txt"}));
+
+  for(std::string name : {"x.pml", "y.txt", "a b/z.pml", "a b/c/w.pml"})
+    std::ofstream(path_join({test_dir, name})) << name;
+
+  // Plain listings, with any flag convertible to bool
+  int fullpath = 1;
+  assert(ls(test_dir).size() == 5);
+  assert(ls(test_dir, fullpath)[2] == test_dir + "/a b");
+
+  std::vector<std::string> files = find_files(test_dir, {".pml"});
+  assert(files == std::vector<std::string>({"x.pml"}));
+
+  files = find_files(test_dir, {".pml", ".txt"}, true);
+  assert(files == std::vector<std::string>({test_dir + "/x.pml",
+                                            test_dir + "/y.txt"}));
+
+  files = find_files(test_dir, {".pml"}, false, true);
+  assert(files == std::vector<std::string>({"a b/c/w.pml", "a b/z.pml",
+                                            "x.pml"}));
+
+  // Links to files are listed, links to directories are not followed
+  assert(symlink("..", path_join({test_dir, "a b/c/loop"}).c_str()) == 0);
+  assert(symlink("../x.pml", path_join({test_dir, "a b/x.pml"}).c_str()) == 0);
+  files = find_files(test_dir, {".pml"}, false, true);
+  assert(files == std::vector<std::string>({"a b/c/w.pml", "a b/x.pml",
+                                            "a b/z.pml", "x.pml"}));
+  assert(rm(path_join({test_dir, "a b/c/loop"})));
+  assert(rm(path_join({test_dir, "a b/x.pml"})));
+
+  // All files, listed by several threads
+  set_num_threads(4);
+  files = find_files(test_dir, {}, false, true);
+  assert(files.size() == 6);
+
+  for(auto &file : find_files(test_dir, {}, true, true))
+    assert(rm(file));
+  assert(find_files(test_dir, {}, false, true).empty());
+
+  std::cout << "OK.\n";
+}
+
+int main(){
+  test_files();
+  test_ls();
+  return 0;
+}
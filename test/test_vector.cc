@@ -95,6 +95,23 @@ void test_load_save(){
   Vector z = Vector::loadTxt("/tmp/test_vector.txt");
   assert(x.equals(z));
 
+  // Load and Save compressed
+  x.save("/tmp/test_vector.pmlz", 1);
+  Vector w = Vector::load("/tmp/test_vector.pmlz");
+  assert(x.equals(w));
+
+  // Compressed, spanning several blocks, without shuffling
+  Vector big(200000);
+  for(size_t i = 0; i < big.size(); ++i)
+    big[i] = std::sqrt(i);
+  big.save("/tmp/test_vector.pmlz", 6, false);
+  Vector big2 = Vector::load("/tmp/test_vector.pmlz");
+  assert(big.equals(big2));
+
+  // Failures are reported
+  assert(!x.save("/nonexistent/test_vector.pml"));
+  assert(!x.save("/nonexistent/test_vector.pmlz", 1));
+
   std::cout << "OK.\n";
 }
 